@@ -0,0 +1,290 @@
+// An adaptive batching consumer that trades latency for throughput only as much as the SLO allows.
+// consumer() in ConsumerProducer.cpp wakes up, pops one item, unlocks and repeats. Under heavy
+// load that's a lock, an unlock and usually a wakeup per item, and whatever per-call cost the
+// processing has (a syscall, a flush, a network write) is also paid per item. Batching fixes that,
+// but a consumer that waits to fill a batch adds latency when the load is light. So:
+//   - drain(max_items, max_wait) takes up to N items. If fewer are queued, it waits at most T
+//     for more. The producer only notifies once the queue holds enough to satisfy a waiter:
+//     any item wakes a consumer that has nothing yet, but one that is filling a batch only
+//     wakes once its batch is full. Any number of consumers can drain the same queue.
+//   - A feedback controller watches the p99 latency of every window of messages against the SLO:
+//       * p99 above the SLO: halve T (stop waiting for stragglers).
+//       * p99 well below the SLO: let T grow (bigger batches, fewer wakeups).
+//       * Batches keep coming back full: there's a backlog, so raise N to drain it faster.
+//       * Batches are mostly far from full: lower N again.
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <set>
+#include <string>
+
+using Clock = std::chrono::steady_clock;
+
+long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+struct Item {
+    long long enqueued_ns;
+};
+
+class BatchingQueue {
+public:
+    void push(Item item) {
+        bool wake_idle, wake_filling;
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            items.push_back(item);
+            // Only wake consumers that can now do what they're waiting for.
+            wake_idle = idle > 0;
+            wake_filling = !fill_targets.empty() && items.size() >= *fill_targets.begin();
+        }
+        if (wake_idle) {
+            idle_cv.notify_one();
+        }
+        if (wake_filling) {
+            fill_cv.notify_all();
+        }
+    }
+
+    // Blocks for the first item, then waits up to max_wait for up to max_items in total.
+    // `backlog` says whether items were left behind. Returns false once closed and empty.
+    bool drain(std::vector<Item>& out, size_t max_items, std::chrono::microseconds max_wait, bool& backlog) {
+        std::unique_lock<std::mutex> lock(mtx);
+        ++idle;
+        idle_cv.wait(lock, [this] { return !items.empty() || closed; });
+        --idle;
+        if (items.size() < max_items && max_wait.count() > 0 && !closed) {
+            auto target = fill_targets.insert(max_items);
+            fill_cv.wait_for(lock, max_wait, [this, max_items] { return items.size() >= max_items || closed; });
+            fill_targets.erase(target);
+        }
+        size_t n = std::min(max_items, items.size());
+        out.assign(items.begin(), items.begin() + n);
+        items.erase(items.begin(), items.begin() + n);
+        backlog = !items.empty();
+        return n > 0;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            closed = true;
+        }
+        idle_cv.notify_all();
+        fill_cv.notify_all();
+    }
+
+private:
+    std::mutex mtx;
+    std::condition_variable idle_cv; // Consumers waiting for their first item.
+    std::condition_variable fill_cv; // Consumers with items, waiting for a fuller batch.
+    std::deque<Item> items;
+    int idle = 0;
+    std::multiset<size_t> fill_targets; // The batch size each filling consumer waits for.
+    bool closed = false;
+};
+
+// AIMD-style controller for the batch size cap N and the fill timeout T.
+class BatchController {
+public:
+    BatchController(std::chrono::microseconds slo, size_t max_n, std::chrono::microseconds max_t)
+        : slo_ns(slo.count() * 1000), max_n(max_n), max_t(max_t) {}
+
+    size_t batch_size() const { return n; }
+    std::chrono::microseconds fill_timeout() const { return t; }
+
+    // Feed every processed batch. Adjusts N and T at the end of each window.
+    // Not thread-safe: one controller per consumer thread.
+    void observe(const std::vector<long long>& latencies_ns, bool backlog) {
+        window.insert(window.end(), latencies_ns.begin(), latencies_ns.end());
+        ++batches;
+        full_batches += latencies_ns.size() >= n ? 1 : 0;
+        backlogged += backlog ? 1 : 0;
+        // A window ends after enough messages for a p99, or after enough batches to react quickly
+        // while N is still small and a backlog is building.
+        if (window.size() < 2000 && batches < 64) {
+            return;
+        }
+
+        auto p99_it = window.begin() + window.size() * 99 / 100;
+        std::nth_element(window.begin(), p99_it, window.end());
+        long long p99 = *p99_it;
+        double avg_batch = static_cast<double>(window.size()) / batches;
+
+        if (p99 > slo_ns) {
+            t /= 2;
+        } else if (p99 < slo_ns / 2) {
+            t = std::min(max_t, t * 2 + std::chrono::microseconds(5));
+        }
+        if (backlogged * 2 > batches || full_batches * 2 > batches) {
+            n = std::min(max_n, n * 2);
+        } else if (avg_batch < n / 4.0 && n > 1) {
+            n /= 2;
+        }
+
+        window.clear();
+        batches = full_batches = backlogged = 0;
+    }
+
+private:
+    long long slo_ns;
+    size_t max_n;
+    std::chrono::microseconds max_t;
+    size_t n = 1;
+    std::chrono::microseconds t{0};
+    std::vector<long long> window;
+    long long batches = 0, full_batches = 0, backlogged = 0;
+};
+
+// --- Benchmark: throughput/latency curves under increasing offered load ---
+
+void spin_for(std::chrono::nanoseconds d) {
+    auto until = Clock::now() + d;
+    while (Clock::now() < until) {
+    }
+}
+
+// The work: a fixed cost per batch (think write() or flush()) plus a small cost per item.
+const std::chrono::microseconds kPerBatch(20);
+const std::chrono::nanoseconds kPerItem(300);
+
+enum class Mode { one_by_one, fixed_batch, adaptive };
+
+struct Point {
+    double throughput;
+    double avg_batch;
+    long long p50_us, p99_us;
+    size_t final_n;
+    long long final_t_us;
+};
+
+Point run(Mode mode, double rate, std::chrono::milliseconds duration, std::chrono::microseconds slo) {
+    BatchingQueue q;
+    BatchController controller(slo, 512, std::chrono::microseconds(2000));
+    std::vector<long long> all_latencies;
+    long long processed = 0;
+    long long batches = 0;
+
+    std::thread consumer([&] {
+        std::vector<Item> batch;
+        std::vector<long long> latencies;
+        while (true) {
+            size_t n = 1;
+            std::chrono::microseconds t(0);
+            if (mode == Mode::fixed_batch) {
+                n = 256;
+                t = std::chrono::microseconds(500);
+            } else if (mode == Mode::adaptive) {
+                n = controller.batch_size();
+                t = controller.fill_timeout();
+            }
+            bool backlog;
+            if (!q.drain(batch, n, t, backlog)) {
+                break;
+            }
+            spin_for(kPerBatch + kPerItem * static_cast<long long>(batch.size()));
+            long long done = now_ns();
+            latencies.clear();
+            for (const Item& item : batch) {
+                latencies.push_back(done - item.enqueued_ns);
+            }
+            all_latencies.insert(all_latencies.end(), latencies.begin(), latencies.end());
+            processed += static_cast<long long>(batch.size());
+            ++batches;
+            if (mode == Mode::adaptive) {
+                controller.observe(latencies, backlog);
+            }
+        }
+    });
+
+    // Open-loop producer: sends at `rate` no matter how the consumer is doing, in 1 ms ticks.
+    auto start = Clock::now();
+    long long sent = 0;
+    while (Clock::now() - start < duration) {
+        auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        long long due = static_cast<long long>(elapsed * rate);
+        for (; sent < due; ++sent) {
+            q.push({now_ns()});
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    q.close();
+    consumer.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::sort(all_latencies.begin(), all_latencies.end());
+    Point p;
+    p.throughput = processed / seconds;
+    p.avg_batch = batches ? static_cast<double>(processed) / batches : 0;
+    p.p50_us = all_latencies.empty() ? 0 : all_latencies[all_latencies.size() / 2] / 1000;
+    p.p99_us = all_latencies.empty() ? 0 : all_latencies[all_latencies.size() * 99 / 100] / 1000;
+    p.final_n = controller.batch_size();
+    p.final_t_us = controller.fill_timeout().count();
+    return p;
+}
+
+// --- Example: two consumers on one queue ---
+
+// One consumer fills batches of 100 with a generous timeout, the other takes items one at a time.
+// The filling consumer must not stop the other one from hearing about new items.
+void two_consumers() {
+    BatchingQueue q;
+    std::atomic<long long> slowest_ns{0};
+    std::thread filler([&q] {
+        std::vector<Item> batch;
+        bool backlog;
+        while (q.drain(batch, 100, std::chrono::microseconds(500000), backlog)) {
+        }
+    });
+    std::thread single([&q, &slowest_ns] {
+        std::vector<Item> batch;
+        bool backlog;
+        while (q.drain(batch, 1, std::chrono::microseconds(0), backlog)) {
+            long long waited = now_ns() - batch[0].enqueued_ns;
+            slowest_ns.store(std::max(slowest_ns.load(), waited));
+        }
+    });
+    for (int i = 0; i < 20; ++i) {
+        q.push({now_ns()});
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    q.close();
+    filler.join();
+    single.join();
+    std::cout << "Two consumers, 20 items 5 ms apart: slowest item waited "
+              << slowest_ns.load() / 1000 << " us (the filler's timeout is 500000 us)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::chrono::milliseconds duration(argc > 1 ? std::stoi(argv[1]) : 400);
+    two_consumers();
+    std::chrono::microseconds slo(1000);
+    std::cout << "Work: " << kPerBatch.count() << " us per batch + " << kPerItem.count()
+              << " ns per item. Latency SLO (p99): " << slo.count() << " us" << std::endl;
+    std::cout << "offered msgs/s, mode, achieved msgs/s, avg batch, p50 us, p99 us" << std::endl;
+
+    for (double rate : {5000.0, 20000.0, 45000.0, 100000.0, 300000.0, 1000000.0}) {
+        struct { Mode mode; const char* name; } modes[] = {
+            {Mode::one_by_one, "one at a time "},
+            {Mode::fixed_batch, "fixed 256/500us"},
+            {Mode::adaptive, "adaptive      "},
+        };
+        for (auto& m : modes) {
+            Point p = run(m.mode, rate, duration, slo);
+            std::cout << static_cast<long long>(rate) << ", " << m.name << ", "
+                      << static_cast<long long>(p.throughput) << ", " << p.avg_batch << ", " << p.p50_us << ", " << p.p99_us;
+            if (m.mode == Mode::adaptive) {
+                std::cout << "  (settled at N=" << p.final_n << ", T=" << p.final_t_us << " us)";
+            }
+            std::cout << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,219 @@
+// A reusable BlockingQueue<T>: ConsumerProducer.cpp packaged as a class.
+// ConsumerProducer.cpp spreads the queue over four globals (data_queue, mtx, cv, finished)
+// and its consumer pops exactly one item per lock. Here:
+//   - The queue, mutex, condition variables and "finished" flag live together in one object.
+//   - "finished" becomes close(): producers can no longer push, and consumers drain whatever
+//     is left and then get an empty std::optional instead of waiting forever.
+//   - An optional capacity makes push() block (and try_push() fail) when the queue is full,
+//     so a fast producer can't run away from slow consumers.
+//   - drain_into() lets a consumer take a whole batch of items under one lock acquisition.
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <optional>
+#include <chrono>
+#include <limits>
+#include <string>
+
+template<class T>
+class BlockingQueue {
+public:
+    explicit BlockingQueue(size_t capacity = std::numeric_limits<size_t>::max())
+        : capacity(capacity) {}
+
+    // Blocks while the queue is full. Returns false if the queue was closed.
+    bool push(T item) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+            if (closed) {
+                return false;
+            }
+            items.push_back(std::move(item));
+        }
+        not_empty.notify_one();
+        return true;
+    }
+
+    // Never blocks. Returns false if the queue is full or closed.
+    bool try_push(T item) {
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            if (closed || items.size() >= capacity) {
+                return false;
+            }
+            items.push_back(std::move(item));
+        }
+        not_empty.notify_one();
+        return true;
+    }
+
+    // Blocks until an item is available. Returns std::nullopt once the queue is closed and empty.
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lock(mtx);
+        not_empty.wait(lock, [this] { return closed || !items.empty(); });
+        return take_one(lock);
+    }
+
+    // Like pop(), but gives up after `timeout`. std::nullopt means "timed out" or "closed and empty".
+    template<class Rep, class Period>
+    std::optional<T> pop_for(const std::chrono::duration<Rep, Period>& timeout) {
+        std::unique_lock<std::mutex> lock(mtx);
+        not_empty.wait_for(lock, timeout, [this] { return closed || !items.empty(); });
+        return take_one(lock);
+    }
+
+    // Blocks until at least one item is available, then moves up to `max` items into `out`
+    // under a single lock. Returns the number of items taken; 0 means closed and empty.
+    size_t drain_into(std::vector<T>& out, size_t max) {
+        size_t count = 0;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            not_empty.wait(lock, [this] { return closed || !items.empty(); });
+            while (count < max && !items.empty()) {
+                out.push_back(std::move(items.front()));
+                items.pop_front();
+                ++count;
+            }
+        }
+        if (count > 0 && capacity != std::numeric_limits<size_t>::max()) {
+            not_full.notify_all(); // Several slots may have opened up at once.
+        }
+        return count;
+    }
+
+    // After close(), pushes fail and pops drain the remaining items, then return empty.
+    void close() {
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            closed = true;
+        }
+        // Wake everyone so they can observe `closed`.
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+private:
+    // Called with the lock held, after waiting.
+    std::optional<T> take_one(std::unique_lock<std::mutex>& lock) {
+        if (items.empty()) {
+            return std::nullopt;
+        }
+        T item = std::move(items.front());
+        items.pop_front();
+        lock.unlock();
+        if (capacity != std::numeric_limits<size_t>::max()) {
+            not_full.notify_one();
+        }
+        return item;
+    }
+
+    std::deque<T> items;
+    std::mutex mtx;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    size_t capacity;
+    bool closed = false;
+};
+
+// --- Example: ConsumerProducer.cpp rewritten on top of BlockingQueue ---
+
+void example() {
+    BlockingQueue<std::string> data_queue;
+
+    std::thread prod([&data_queue] {
+        for (int i = 0; i < 5; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            std::string data = "Data packet " + std::to_string(i);
+            data_queue.push(data); // Moves into the queue; the lock/notify dance is inside.
+            std::cout << "Producer: Pushed '" << data << "' to the queue." << std::endl;
+        }
+        data_queue.close(); // Replaces `finished = true; cv.notify_all();`
+    });
+
+    auto consumer = [&data_queue] {
+        // pop() only returns empty once the queue is closed AND drained.
+        while (std::optional<std::string> data = data_queue.pop()) {
+            std::cout << "Consumer: Processed '" << *data << "'" << std::endl;
+        }
+        std::cout << "Consumer: Finished." << std::endl;
+    };
+    std::thread cons(consumer);
+    std::thread cons2(consumer);
+
+    prod.join();
+    cons.join();
+    cons2.join();
+
+    // pop_for() is the building block for consumers that also have other things to do.
+    BlockingQueue<int> idle;
+    auto start = std::chrono::steady_clock::now();
+    std::optional<int> nothing = idle.pop_for(std::chrono::milliseconds(50));
+    std::cout << "pop_for on an empty queue returned "
+              << (nothing ? "a value" : "nothing") << " after "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - start).count()
+              << " ms" << std::endl;
+}
+
+// --- Benchmark: consumer throughput by batch size ---
+
+double bench(size_t batch, long long items_per_producer, int producers, int consumers) {
+    BlockingQueue<long long> q(4096);
+    std::vector<std::thread> threads;
+    std::vector<long long> sums(consumers, 0);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&q, items_per_producer] {
+            for (long long i = 0; i < items_per_producer; ++i) {
+                q.push(i);
+            }
+        });
+    }
+    for (int c = 0; c < consumers; ++c) {
+        threads.emplace_back([&q, &sums, c, batch] {
+            std::vector<long long> got;
+            got.reserve(batch);
+            while (q.drain_into(got, batch) > 0) {
+                for (long long v : got) {
+                    sums[c] += v;
+                }
+                got.clear();
+            }
+        });
+    }
+    for (int p = 0; p < producers; ++p) {
+        threads[p].join();
+    }
+    q.close();
+    for (size_t i = producers; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    long long total = 0;
+    for (long long s : sums) {
+        total += s;
+    }
+    long long expected = producers * (items_per_producer * (items_per_producer - 1) / 2);
+    if (total != expected) {
+        std::cout << "  ERROR: lost or duplicated items" << std::endl;
+    }
+    return producers * items_per_producer / seconds;
+}
+
+int main(int argc, char* argv[]) {
+    example();
+
+    long long n = argc > 1 ? std::stoll(argv[1]) : 1000000;
+    std::cout << "\nBenchmark: 2 producers -> 2 consumers, " << 2 * n << " items, capacity 4096" << std::endl;
+    for (size_t batch : {1, 16, 256}) {
+        std::cout << "drain_into batch " << batch << ": "
+                  << static_cast<long long>(bench(batch, n, 2, 2)) << " items/s" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,309 @@
+// Zero-copy, pooled message buffers for producer/consumer queues.
+// In ConsumerProducer.cpp every packet costs several heap allocations and copies:
+//   - producer() builds a fresh std::string ("Data packet " + ... allocates once it outgrows
+//     the small-string buffer),
+//   - data_queue.push(data) copies it into the queue,
+//   - consumer() copies it out again with data_queue.front() instead of moving it.
+// Here messages live in a BufferPool: one up-front allocation carved into fixed-size slabs.
+//   - The producer acquires a slab and writes the message into it in place.
+//   - What travels through the queue is a MessageRef: a pointer-sized, reference-counted handle.
+//     Moving it into and out of the queue moves the handle; the bytes never move.
+//   - Copying a MessageRef (e.g. to fan a message out) only bumps the reference count.
+//   - When the last MessageRef goes away, the slab goes back on the pool's free list.
+// The free list is a lock-free stack of slab indices. Each push or pop changes the head with one
+// CAS, and a version tag packed next to the index stops the ABA problem: a head that was popped
+// and pushed back in between can't be mistaken for the one we read.
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// --- Allocation counting: every plain operator new in the program goes through here ---
+
+std::atomic<long long> allocations{0};
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+// Copies of a message, whichever representation it has. Bumped by CountedString below and by
+// MessageRef's copy constructor, so both benchmark rows are measured the same way.
+std::atomic<long long> payload_copies{0};
+
+// --- The pool ---
+
+class BufferPool;
+
+// Lives at the start of every slab; the payload follows it.
+struct SlabHeader {
+    std::atomic<int> refs{0};
+    std::atomic<uint32_t> next;  // Free-list link, only meaningful while the slab is free.
+    uint32_t size = 0;           // Bytes of payload written.
+    uint32_t index;
+};
+
+class MessageRef {
+public:
+    MessageRef() = default;
+    MessageRef(BufferPool* pool, SlabHeader* slab) : pool(pool), slab(slab) {}
+
+    // Shares the bytes instead of duplicating them, but it's still a copy of the message, so it's
+    // counted: a data path that really moves its handles reports none.
+    MessageRef(const MessageRef& other) : pool(other.pool), slab(other.slab) {
+        if (slab) {
+            slab->refs.fetch_add(1, std::memory_order_relaxed);
+            payload_copies.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    MessageRef(MessageRef&& other) noexcept : pool(other.pool), slab(other.slab) {
+        other.slab = nullptr;
+    }
+    MessageRef& operator=(MessageRef other) noexcept {
+        std::swap(pool, other.pool);
+        std::swap(slab, other.slab);
+        return *this;
+    }
+    ~MessageRef() { reset(); }
+
+    void reset();
+
+    explicit operator bool() const { return slab != nullptr; }
+    char* data() { return reinterpret_cast<char*>(slab + 1); }
+    const char* data() const { return reinterpret_cast<const char*>(slab + 1); }
+    size_t capacity() const;
+    // Throws if n is more than was allocated: view() would read past the slab.
+    void set_size(size_t n) {
+        if (n > capacity()) {
+            throw std::runtime_error("MessageRef::set_size: " + std::to_string(n) + " bytes exceeds capacity " +
+                                     std::to_string(capacity()));
+        }
+        slab->size = static_cast<uint32_t>(n);
+    }
+    std::string_view view() const { return {data(), slab->size}; }
+
+private:
+    BufferPool* pool = nullptr;
+    SlabHeader* slab = nullptr;
+};
+
+class BufferPool {
+public:
+    BufferPool(size_t num_slabs, size_t payload_size) : payload_size(payload_size) {
+        // Round each slab up to whole cache lines, so two slabs never share one.
+        stride = (sizeof(SlabHeader) + payload_size + 63) / 64 * 64;
+        memory = static_cast<unsigned char*>(::operator new(num_slabs * stride, std::align_val_t(64)));
+        for (size_t i = 0; i < num_slabs; ++i) {
+            SlabHeader* s = new (memory + i * stride) SlabHeader();
+            s->index = static_cast<uint32_t>(i);
+            s->next.store(i + 1 < num_slabs ? static_cast<uint32_t>(i + 1) : kNil);
+        }
+        head.store(num_slabs > 0 ? 0 : kNil);
+        count = num_slabs;
+    }
+
+    ~BufferPool() {
+        for (size_t i = 0; i < count; ++i) {
+            slab_at(static_cast<uint32_t>(i))->~SlabHeader();
+        }
+        ::operator delete(memory, std::align_val_t(64));
+    }
+
+    // Returns an empty MessageRef if every slab is in use.
+    MessageRef try_acquire() {
+        uint64_t h = head.load(std::memory_order_acquire);
+        while (true) {
+            uint32_t idx = static_cast<uint32_t>(h);
+            if (idx == kNil) {
+                return MessageRef();
+            }
+            uint32_t next = slab_at(idx)->next.load(std::memory_order_relaxed);
+            uint64_t new_head = ((h >> 32) + 1) << 32 | next;
+            if (head.compare_exchange_weak(h, new_head, std::memory_order_acquire)) {
+                SlabHeader* s = slab_at(idx);
+                s->refs.store(1, std::memory_order_relaxed);
+                s->size = 0;
+                return MessageRef(this, s);
+            }
+        }
+    }
+
+    // Waits for a slab to come back when the pool is exhausted: natural backpressure.
+    MessageRef acquire() {
+        while (true) {
+            if (MessageRef m = try_acquire()) {
+                return m;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    size_t payload_capacity() const { return payload_size; }
+
+private:
+    friend class MessageRef;
+    static const uint32_t kNil = 0xFFFFFFFF;
+
+    SlabHeader* slab_at(uint32_t idx) { return reinterpret_cast<SlabHeader*>(memory + idx * stride); }
+
+    void release(SlabHeader* s) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        while (true) {
+            s->next.store(static_cast<uint32_t>(h), std::memory_order_relaxed);
+            uint64_t new_head = ((h >> 32) + 1) << 32 | s->index;
+            // Release: the consumer's reads of the payload happen before the next producer's writes.
+            if (head.compare_exchange_weak(h, new_head, std::memory_order_release, std::memory_order_relaxed)) {
+                return;
+            }
+        }
+    }
+
+    unsigned char* memory;
+    size_t payload_size;
+    size_t stride;
+    size_t count;
+    std::atomic<uint64_t> head; // High 32 bits: version tag. Low 32 bits: index of the top slab.
+};
+
+void MessageRef::reset() {
+    if (slab && slab->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        pool->release(slab);
+    }
+    slab = nullptr;
+}
+
+size_t MessageRef::capacity() const { return pool->payload_capacity(); }
+
+// --- Benchmark: ConsumerProducer.cpp's data path, before and after ---
+
+// The baseline payload: a std::string that counts how often it gets copied.
+
+struct CountedString {
+    std::string s;
+
+    CountedString() = default;
+    explicit CountedString(std::string s) : s(std::move(s)) {}
+    CountedString(const CountedString& other) : s(other.s) { payload_copies.fetch_add(1, std::memory_order_relaxed); }
+    CountedString(CountedString&&) = default;
+    CountedString& operator=(const CountedString& other) {
+        s = other.s;
+        payload_copies.fetch_add(1, std::memory_order_relaxed);
+        return *this;
+    }
+    CountedString& operator=(CountedString&&) = default;
+};
+
+// The same queue, mutex, condition variable and finished flag as ConsumerProducer.cpp.
+template<class T, class Produce, class Consume>
+double run(long long n, Produce produce, Consume consume) {
+    std::queue<T> data_queue;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool finished = false;
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread prod([&] {
+        for (long long i = 0; i < n; ++i) {
+            produce(data_queue, mtx, i);
+            cv.notify_one();
+        }
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            finished = true;
+        }
+        cv.notify_all();
+    });
+    auto consumer = [&] {
+        while (true) {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&] { return !data_queue.empty() || finished; });
+            if (data_queue.empty()) {
+                break;
+            }
+            consume(data_queue, lock);
+        }
+    };
+    std::thread cons(consumer);
+    std::thread cons2(consumer);
+    prod.join();
+    cons.join();
+    cons2.join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::atomic<long long> checksum{0};
+
+void report(const std::string& name, long long n, double seconds, long long allocs, long long copies) {
+    std::cout << name << ": " << static_cast<long long>(n / seconds) << " msgs/s, "
+              << static_cast<double>(allocs) / n << " allocations/msg, "
+              << static_cast<double>(copies) / n << " payload copies/msg" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    long long n = argc > 1 ? std::stoll(argv[1]) : 2000000;
+    std::cout << "Benchmark: 1 producer -> 2 consumers, " << n << " messages" << std::endl;
+
+    // Before: exactly what ConsumerProducer.cpp does, minus the sleep and the printing.
+    long long allocs_before = allocations.load();
+    payload_copies = 0;
+    double t = run<CountedString>(n,
+        [](std::queue<CountedString>& q, std::mutex& mtx, long long i) {
+            CountedString data("Data packet " + std::to_string(i));
+            std::lock_guard<std::mutex> guard(mtx);
+            q.push(data);
+        },
+        [](std::queue<CountedString>& q, std::unique_lock<std::mutex>& lock) {
+            CountedString data = q.front();
+            q.pop();
+            lock.unlock();
+            checksum.fetch_add(data.s.size(), std::memory_order_relaxed);
+        });
+    report("std::string, copied      ", n, t, allocations.load() - allocs_before, payload_copies.load());
+
+    // After: pooled slabs, written in place, handle moved through the queue.
+    BufferPool pool(4096, 64);
+    allocs_before = allocations.load();
+    payload_copies = 0;
+    t = run<MessageRef>(n,
+        [&pool](std::queue<MessageRef>& q, std::mutex& mtx, long long i) {
+            MessageRef buf = pool.acquire();
+            int len = std::snprintf(buf.data(), buf.capacity(), "Data packet %lld", i);
+            buf.set_size(static_cast<size_t>(len));
+            std::lock_guard<std::mutex> guard(mtx);
+            q.push(std::move(buf));
+        },
+        [](std::queue<MessageRef>& q, std::unique_lock<std::mutex>& lock) {
+            MessageRef data = std::move(q.front());
+            q.pop();
+            lock.unlock();
+            checksum.fetch_add(data.view().size(), std::memory_order_relaxed);
+        }); // `data` goes out of scope here and the slab returns to the pool.
+    report("pooled MessageRef, moved ", n, t, allocations.load() - allocs_before, payload_copies.load());
+    std::cout << "(The remaining allocations are std::queue's own chunks, plus the threads.)" << std::endl;
+
+    MessageRef buf = pool.acquire();
+    try {
+        buf.set_size(buf.capacity() + 1);
+    } catch (const std::runtime_error& e) {
+        std::cout << "Rejected: " << e.what() << std::endl;
+    }
+    return 0;
+}
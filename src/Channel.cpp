@@ -0,0 +1,413 @@
+// Go-style channels, with a select() that waits on several channels and a timeout at once.
+// ConsumerProducer.cpp has a single condition variable, so a consumer can only wait for one
+// thing. To watch data, control messages and a timeout together, you end up polling every
+// source in a loop. That either burns a CPU or, with a sleep in the loop, adds latency.
+//   - Channel<T>(0) is unbuffered: send() returns only once a receiver has taken the value.
+//   - Channel<T>(n) is buffered: send() only blocks while n values are already waiting.
+//   - close() ends the stream: receivers drain what's left and then see std::nullopt.
+//     An unbuffered send that no receiver has taken yet throws, and its value is discarded.
+//   - select() takes a number of on_recv(channel, handler) cases and an optional timeout.
+//     The waiting thread parks on its own private Waiter (a mutex + condition variable) and
+//     registers that Waiter with every channel it's interested in. A send wakes exactly one
+//     registered Waiter that hasn't already been woken. Nobody polls, and a send doesn't wake
+//     the whole herd.
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <optional>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <ctime>
+
+// One per blocked select() call. Channels flip `signaled` and say which case woke it.
+struct Waiter {
+    std::mutex m;
+    std::condition_variable cv;
+    bool signaled = false;
+    int fired_by = -1;
+};
+
+template<class T, class F>
+class RecvCase;
+
+template<class T>
+class Channel {
+public:
+    explicit Channel(size_t capacity = 0) : capacity(capacity) {}
+
+    void send(T value) {
+        std::unique_lock<std::mutex> lock(mtx);
+        if (capacity > 0) {
+            send_cv.wait(lock, [this] { return closed || items.size() < capacity; });
+        }
+        if (closed) {
+            throw std::runtime_error("send on closed channel");
+        }
+        items.push_back(std::move(value));
+        unsigned long long ticket = sent++;
+        wake_one();
+        if (capacity == 0) {
+            // Unbuffered: rendezvous with the receiver that takes our value.
+            send_cv.wait(lock, [this, ticket] { return closed || received > ticket; });
+            if (received <= ticket) {
+                throw std::runtime_error("channel closed before the value was received");
+            }
+        }
+    }
+
+    // Never blocks. Returns false if nothing is waiting.
+    bool try_recv(T& out) {
+        std::lock_guard<std::mutex> guard(mtx);
+        if (items.empty()) {
+            return false;
+        }
+        out = *take();
+        return true;
+    }
+
+    // Blocks until a value arrives. std::nullopt means the channel is closed and drained.
+    std::optional<T> recv();
+
+    void close() {
+        std::lock_guard<std::mutex> guard(mtx);
+        closed = true;
+        // Unbuffered values all belong to senders still waiting for a receiver. They're about
+        // to throw, so a receiver mustn't get the value as well.
+        if (capacity == 0) {
+            items.clear();
+        }
+        // Everybody can make progress now: receivers see nullopt, senders throw.
+        for (auto& entry : waiters) {
+            signal(entry.first, entry.second);
+        }
+        send_cv.notify_all();
+    }
+
+private:
+    template<class U, class F>
+    friend class RecvCase;
+
+    // The functions below expect `mtx` to be held.
+
+    bool ready() const { return closed || !items.empty(); }
+
+    std::optional<T> take() {
+        if (items.empty()) {
+            return std::nullopt;
+        }
+        T value = std::move(items.front());
+        items.pop_front();
+        ++received;
+        // Buffered: one slot opened up. Unbuffered: the sender with our ticket must wake up.
+        if (capacity > 0) {
+            send_cv.notify_one();
+        } else {
+            send_cv.notify_all();
+        }
+        return value;
+    }
+
+    // Wakes the first registered waiter that isn't already awake.
+    // A waiter is woken at most once per registration, so each new value wakes a different waiter.
+    void wake_one() {
+        for (auto& entry : waiters) {
+            if (signal(entry.first, entry.second)) {
+                return;
+            }
+        }
+    }
+
+    static bool signal(Waiter* w, int case_index) {
+        std::lock_guard<std::mutex> guard(w->m);
+        if (w->signaled) {
+            return false;
+        }
+        w->signaled = true;
+        w->fired_by = case_index;
+        w->cv.notify_one();
+        return true;
+    }
+
+    void add_waiter(Waiter* w, int case_index) { waiters.emplace_back(w, case_index); }
+
+    void remove_waiter(Waiter* w) {
+        waiters.erase(std::remove_if(waiters.begin(), waiters.end(),
+                                     [w](const std::pair<Waiter*, int>& e) { return e.first == w; }),
+                      waiters.end());
+    }
+
+    std::mutex mtx;
+    std::condition_variable send_cv;
+    std::deque<T> items;
+    std::vector<std::pair<Waiter*, int>> waiters;
+    size_t capacity;
+    unsigned long long sent = 0;
+    unsigned long long received = 0;
+    bool closed = false;
+};
+
+// The type-erased view select() has of one case.
+class SelectCase {
+public:
+    virtual ~SelectCase() = default;
+    // Takes a value if the channel is ready; otherwise registers w. One lock acquisition either way.
+    virtual bool take_or_register(Waiter& w, int case_index) = 0;
+    virtual void unregister(Waiter& w) = 0;
+    // We were woken for this case but chose another one: give the wakeup to someone else.
+    virtual void pass_wakeup() = 0;
+    // Runs the handler on the taken value, outside every lock.
+    virtual void fire() = 0;
+};
+
+template<class T, class F>
+class RecvCase : public SelectCase {
+public:
+    RecvCase(Channel<T>& ch, F handler) : ch(ch), handler(std::move(handler)) {}
+
+    bool take_or_register(Waiter& w, int case_index) override {
+        std::lock_guard<std::mutex> guard(ch.mtx);
+        if (ch.ready()) {
+            value = ch.take(); // std::nullopt if the channel is closed.
+            return true;
+        }
+        ch.add_waiter(&w, case_index);
+        return false;
+    }
+
+    void unregister(Waiter& w) override {
+        std::lock_guard<std::mutex> guard(ch.mtx);
+        ch.remove_waiter(&w);
+    }
+
+    void pass_wakeup() override {
+        std::lock_guard<std::mutex> guard(ch.mtx);
+        if (ch.ready()) {
+            ch.wake_one();
+        }
+    }
+
+    void fire() override { handler(std::move(value)); }
+
+private:
+    Channel<T>& ch;
+    F handler;
+    std::optional<T> value;
+};
+
+// A case for select(): when `ch` has a value (or is closed), call handler(std::optional<T>).
+template<class T, class F>
+RecvCase<T, F> on_recv(Channel<T>& ch, F handler) {
+    return RecvCase<T, F>(ch, std::move(handler));
+}
+
+// Returns the index of the case that fired, or -1 if the deadline passed first.
+int select_impl(SelectCase* const* cases, int n,
+                std::optional<std::chrono::steady_clock::time_point> deadline) {
+    Waiter w;
+    // Start scanning at a different case each call, so an always-busy first channel can't
+    // starve the others.
+    thread_local unsigned rotation = 0;
+    int start = static_cast<int>(rotation++ % n);
+
+    while (true) {
+        int fired = -1;
+        int scanned = 0;
+        for (; scanned < n; ++scanned) {
+            int i = (start + scanned) % n;
+            if (cases[i]->take_or_register(w, i)) {
+                fired = i;
+                break;
+            }
+        }
+
+        if (fired < 0) {
+            std::unique_lock<std::mutex> lock(w.m);
+            if (deadline) {
+                w.cv.wait_until(lock, *deadline, [&w] { return w.signaled; });
+            } else {
+                w.cv.wait(lock, [&w] { return w.signaled; });
+            }
+        }
+
+        // After unregistering nobody can signal us any more, so `w` is stable.
+        for (int k = 0; k < scanned; ++k) {
+            cases[(start + k) % n]->unregister(w);
+        }
+        bool woken;
+        int woken_by;
+        {
+            std::lock_guard<std::mutex> guard(w.m);
+            woken = w.signaled;
+            woken_by = w.fired_by;
+            w.signaled = false;
+        }
+
+        if (fired >= 0) {
+            if (woken && woken_by != fired) {
+                cases[woken_by]->pass_wakeup();
+            }
+            cases[fired]->fire();
+            return fired;
+        }
+        if (!woken) {
+            return -1; // Timed out.
+        }
+        // Start with the channel that woke us: that's where the value is.
+        start = woken_by;
+    }
+}
+
+template<class... Cases>
+int select(Cases&&... cases) {
+    SelectCase* list[] = {&cases...};
+    return select_impl(list, sizeof...(Cases), std::nullopt);
+}
+
+template<class Rep, class Period, class... Cases>
+int select_for(const std::chrono::duration<Rep, Period>& timeout, Cases&&... cases) {
+    SelectCase* list[] = {&cases...};
+    return select_impl(list, sizeof...(Cases), std::chrono::steady_clock::now() + timeout);
+}
+
+template<class T>
+std::optional<T> Channel<T>::recv() {
+    std::optional<T> out;
+    select(on_recv(*this, [&out](std::optional<T> v) { out = std::move(v); }));
+    return out;
+}
+
+// --- Example: one consumer waiting on data, control and a timeout, with no polling ---
+
+void example() {
+    Channel<std::string> data(4);
+    Channel<int> control; // Unbuffered.
+
+    std::thread prod([&data, &control] {
+        for (int i = 0; i < 3; ++i) {
+            data.send("Data packet " + std::to_string(i));
+            std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(120)); // Long enough for a timeout.
+        control.send(0); // Returns only after the consumer has received it.
+        std::cout << "Producer: Stop request was received." << std::endl;
+    });
+
+    bool running = true;
+    while (running) {
+        int which = select_for(std::chrono::milliseconds(100),
+            on_recv(data, [](std::optional<std::string> d) {
+                std::cout << "Consumer: Processed '" << *d << "'" << std::endl;
+            }),
+            on_recv(control, [&running](std::optional<int>) {
+                std::cout << "Consumer: Got stop request." << std::endl;
+                running = false;
+            }));
+        if (which < 0) {
+            std::cout << "Consumer: Nothing for 100 ms." << std::endl;
+        }
+    }
+    prod.join();
+
+    // Closing wakes every receiver; recv() then drains and returns nullopt.
+    Channel<int> numbers(8);
+    numbers.send(1);
+    numbers.send(2);
+    numbers.close();
+    while (std::optional<int> n = numbers.recv()) {
+        std::cout << "Drained " << *n << " after close" << std::endl;
+    }
+}
+
+// --- Benchmark: fan-in of 8 channels, select vs polling loops ---
+
+struct Stamped {
+    long long sent_ns = 0;
+};
+
+long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double thread_cpu_ms() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+enum class Mode { select, poll_yield, poll_sleep };
+
+void bench(const std::string& name, Mode mode, int messages_per_source) {
+    const int kSources = 8;
+    std::deque<Channel<Stamped>> channels; // Channels aren't movable; deque doesn't need them to be.
+    for (int i = 0; i < kSources; ++i) {
+        channels.emplace_back(64);
+    }
+
+    // Sparse traffic: each source sends a message every ~200 us.
+    std::vector<std::thread> producers;
+    for (int i = 0; i < kSources; ++i) {
+        producers.emplace_back([&channels, i, messages_per_source] {
+            for (int k = 0; k < messages_per_source; ++k) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                channels[i].send({now_ns()});
+            }
+        });
+    }
+
+    std::vector<long long> latencies;
+    int total = kSources * messages_per_source;
+    latencies.reserve(total);
+    double cpu_start = thread_cpu_ms();
+    auto record = [&latencies](std::optional<Stamped> s) { latencies.push_back(now_ns() - s->sent_ns); };
+
+    while (static_cast<int>(latencies.size()) < total) {
+        if (mode == Mode::select) {
+            select(on_recv(channels[0], record), on_recv(channels[1], record),
+                   on_recv(channels[2], record), on_recv(channels[3], record),
+                   on_recv(channels[4], record), on_recv(channels[5], record),
+                   on_recv(channels[6], record), on_recv(channels[7], record));
+        } else {
+            bool got_any = false;
+            Stamped s;
+            for (Channel<Stamped>& ch : channels) {
+                if (ch.try_recv(s)) {
+                    record(s);
+                    got_any = true;
+                }
+            }
+            if (!got_any) {
+                if (mode == Mode::poll_yield) {
+                    std::this_thread::yield();
+                } else {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+            }
+        }
+    }
+    double cpu_ms = thread_cpu_ms() - cpu_start;
+    for (std::thread& t : producers) {
+        t.join();
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << name << ": consumer CPU " << cpu_ms << " ms, latency p50 "
+              << latencies[latencies.size() / 2] / 1000 << " us, p99 "
+              << latencies[latencies.size() * 99 / 100] / 1000 << " us" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    example();
+
+    int n = argc > 1 ? std::stoi(argv[1]) : 2000;
+    std::cout << "\nBenchmark: 8 sources x " << n << " messages, one every ~200 us per source" << std::endl;
+    bench("select over 8 channels   ", Mode::select, n);
+    bench("poll loop + yield        ", Mode::poll_yield, n);
+    bench("poll loop + sleep 100 us ", Mode::poll_sleep, n);
+    return 0;
+}
@@ -0,0 +1,236 @@
+// A NUMA-aware cohort lock: keeps a contended lock on one socket for a while before letting it
+// cross to the other.
+// On a two-socket machine, every time a contended std::mutex goes to a thread on the other
+// socket, the lock word and everything the critical section touches cross the interconnect,
+// which costs several times more than a transfer between cores of the same socket.
+// std::mutex doesn't know where its waiters are, so with threads on both sockets about half of
+// its handoffs are remote. A cohort lock (Dice, Marathe, Shavit, 2012) is built from two locks:
+//   - one local lock per socket, which only that socket's threads use,
+//   - one global lock, which belongs to a socket (a "cohort") rather than to a thread.
+// A thread takes its socket's local lock, then the global lock, unless its socket already
+// holds it. When it unlocks and another thread of the same socket is waiting, it keeps the global
+// lock for the socket and only releases the local lock: the handoff stays on the socket. After
+// max_handoffs (64 by default) local handoffs in a row the global lock is released anyway, so
+// the other sockets don't starve.
+// The global lock is released by whichever thread of the cohort happens to be last, not
+// necessarily the one that took it, so it can't be a std::mutex: it's a test-and-set spinlock. At
+// most one thread per socket ever waits for it. The local locks are std::mutex, so waiters sleep.
+// A strictly FIFO global lock (a ticket lock, as in the paper) would make the sockets alternate
+// even when the next socket's thread isn't running, which costs a context switch per handoff
+// once threads outnumber cores. Instead the global lock is taken by whoever gets there first,
+// and a socket that has waited too long marks itself `starving`: then the current socket stops
+// passing the lock around locally, and nobody else may take the global lock until it has.
+// Sockets come from getcpu(), which reports the NUMA node the thread is running on. That
+// lookup is cached and refreshed every kRecheck acquisitions. A stale answer after the
+// scheduler moves a thread only costs locality, never correctness. On a single-socket machine
+// you can pass a simulated socket count instead: threads are then dealt out to sockets in turn.
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <queue>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <string>
+#include <fstream>
+#include <sched.h>
+#include "locks/CohortLock.h"
+
+// --- ThreadPool.cpp's pool, with the mutex type as a parameter ---
+
+template<class Mutex>
+class ThreadPool {
+public:
+    ThreadPool(size_t num_threads) : stop(false) {
+        for (size_t i = 0; i < num_threads; ++i) {
+            workers.emplace_back([this] {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<Mutex> lock(this->queue_mutex);
+                        this->condition.wait(lock, [this] { return this->stop || !this->tasks.empty(); });
+                        if (this->stop && this->tasks.empty()) {
+                            return;
+                        }
+                        task = std::move(this->tasks.front());
+                        this->tasks.pop();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    template<class F, class... Args>
+    auto submit(F&& f, Args&&... args) -> std::future<decltype(f(args...))> {
+        using return_type = decltype(f(args...));
+        auto task = std::make_shared<std::packaged_task<return_type()>>(
+            std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+        std::future<return_type> res = task->get_future();
+        {
+            std::unique_lock<Mutex> lock(queue_mutex);
+            if (stop) {
+                throw std::runtime_error("submit on stopped ThreadPool");
+            }
+            tasks.emplace([task]() { (*task)(); });
+        }
+        condition.notify_one();
+        return res;
+    }
+
+    ~ThreadPool() {
+        {
+            std::unique_lock<Mutex> lock(queue_mutex);
+            stop = true;
+        }
+        condition.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+
+    Mutex queue_mutex;
+    std::conditional_t<std::is_same<Mutex, std::mutex>::value, std::condition_variable, std::condition_variable_any>
+        condition;
+    bool stop;
+};
+
+// --- Benchmark: std::mutex vs CohortLock, threads spread over two sockets ---
+
+// On a single-socket machine the interconnect is simulated too: whenever the critical section
+// runs on a different socket than the previous one, it first burns `remote_ns`, roughly what
+// pulling the protected lines across the interconnect costs.
+// With fewer cores than threads a lock is only contended while its holder is descheduled, so the
+// critical section can also give up its CPU every `yield_every` operations to make that happen.
+struct Shared {
+    long long counter = 0;
+    int last_socket = -1;
+    long long remote_handoffs = 0;
+};
+
+inline void burn(int ns) {
+    auto until = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+    while (std::chrono::steady_clock::now() < until) {
+        cpu_relax();
+    }
+}
+
+inline void critical_section(Shared& s, int socket, int remote_ns, int yield_every) {
+    if (socket != s.last_socket) {
+        if (s.last_socket >= 0) {
+            ++s.remote_handoffs;
+            burn(remote_ns);
+        }
+        s.last_socket = socket;
+    }
+    s.counter++;
+    if (yield_every && s.counter % yield_every == 0) {
+        std::this_thread::yield();
+    }
+}
+
+struct Result {
+    double ns_per_op;
+    double remote_percent;
+    double fairness; // min/max of per-thread ops.
+    bool correct;
+};
+
+// With real sockets, thread t is pinned to CPU t, so the threads spread over all nodes. Simulated,
+// they're dealt out to sockets in turn: an even number of threads splits evenly.
+template<class Lock>
+Result run(Lock& lock, int threads, int simulated, int remote_ns, int yield_every,
+           std::chrono::milliseconds duration) {
+    Shared shared;
+    std::vector<long long> ops(threads, 0);
+    std::atomic<bool> go{false}, stop{false};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            if (!simulated) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(t % std::thread::hardware_concurrency(), &set);
+                sched_setaffinity(0, sizeof(set), &set);
+            }
+            int socket = this_thread_socket(simulated);
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            long long n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                std::lock_guard<Lock> guard(lock);
+                critical_section(shared, socket, remote_ns, yield_every);
+                ++n;
+            }
+            ops[t] = n;
+        });
+    }
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (std::thread& w : workers) {
+        w.join();
+    }
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+
+    long long total = 0;
+    for (long long n : ops) {
+        total += n;
+    }
+    auto [lo, hi] = std::minmax_element(ops.begin(), ops.end());
+    return {ns / static_cast<double>(total), 100.0 * static_cast<double>(shared.remote_handoffs) / static_cast<double>(total),
+            *hi > 0 ? static_cast<double>(*lo) / static_cast<double>(*hi) : 0, shared.counter == total};
+}
+
+void report(const char* name, const Result& r) {
+    char line[160];
+    std::snprintf(line, sizeof(line), "  %-12s %8.1f ns/op   cross-socket handoffs %5.2f%%   fairness %.2f   %s", name,
+                  r.ns_per_op, r.remote_percent, r.fairness, r.correct ? "ok" : "WRONG COUNT");
+    std::cout << line << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::chrono::milliseconds duration(argc > 1 ? std::stoi(argv[1]) : 200);
+    int remote_ns = argc > 2 ? std::stoi(argv[2]) : 200;
+
+    ThreadPool<CohortLock> pool(4);
+    auto sum = pool.submit([](int x, int y) { return x + y; }, 5, 3);
+    std::cout << "ThreadPool<CohortLock>: 5 + 3 = " << sum.get() << std::endl;
+
+    // Use the real topology if this machine has more than one NUMA node, otherwise simulate two.
+    int nodes = max_numa_node() + 1;
+    bool simulated = nodes == 1;
+    int sockets = simulated ? 2 : nodes;
+    std::cout << "Benchmark: " << duration.count() << " ms per run, " << std::thread::hardware_concurrency()
+              << " hardware threads, " << sockets << (simulated ? " simulated sockets, " : " NUMA nodes, ")
+              << (simulated ? std::to_string(remote_ns) + " ns per simulated cross-socket transfer" : std::string())
+              << std::endl;
+
+    int sim = simulated ? sockets : 0;
+    for (int yield_every : {0, 16}) {
+        for (int threads : {2, 4, 8, 16}) {
+            std::cout << threads << " threads over " << sockets << " sockets, "
+                      << (yield_every ? "holder yields every " + std::to_string(yield_every) + " ops"
+                                      : std::string("back to back"))
+                      << std::endl;
+            std::mutex m;
+            report("std::mutex", run(m, threads, sim, simulated ? remote_ns : 0, yield_every, duration));
+            CohortLock cohort(sim);
+            report("CohortLock", run(cohort, threads, sim, simulated ? remote_ns : 0, yield_every, duration));
+        }
+    }
+    return 0;
+}
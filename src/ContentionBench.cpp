@@ -0,0 +1,311 @@
+// A contention benchmark for the counting strategies in DataRace.cpp, Mutex.cpp, LockGuard.cpp,
+// Atomic.cpp and StripedCounter.cpp, and for LockGuard.cpp's counter++ under the locks in locks/
+// that SpinLocks.cpp, FutexMutex.cpp, ReadMostly.cpp (RwLock, exclusive side), FlatCombining.cpp
+// and CohortLock.cpp demonstrate.
+// Each of those files does 2 x 100000 increments and prints the total, which says whether the
+// strategy is correct but nothing about what it costs. Here every strategy runs at 1..16
+// threads for a fixed time, and for each run we report:
+//   - ns/op: wall time divided by the total increments all threads managed.
+//   - fairness: how evenly the increments were spread over the threads. min/max is the share
+//     of the slowest thread relative to the fastest; 1.0 means perfectly even. A lock that
+//     lets one thread re-acquire it over and over shows up here even if its ns/op looks good.
+//   - cycles and cache misses per op, from perf_event_open, when the kernel lets us count them
+//     (in containers and VMs it often doesn't, and we print n/a).
+//   - whether the final count is right: data_race loses updates, the others must not.
+// Strategies are rows in one table, so new lock types only need a new row. Every row pays the
+// same indirect call per increment (a couple of ns), which matters only next to the cheapest ones.
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "locks/SpinLocks.h"
+#include "locks/FutexMutex.h"
+#include "locks/RwLock.h"
+#include "locks/FlatCombining.h"
+#include "locks/CohortLock.h"
+
+// --- Hardware counters ---
+
+// One perf counter for this process and every thread it starts afterwards (inherit).
+class PerfCounter {
+public:
+    PerfCounter(uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    ~PerfCounter() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    bool available() const { return fd >= 0; }
+
+    void start() {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    // Counts from threads that have exited are folded in, so call this after joining them.
+    long long stop() {
+        long long value = -1;
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &value, sizeof(value)) != sizeof(value)) {
+                value = -1;
+            }
+        }
+        return value;
+    }
+
+private:
+    int fd;
+};
+
+// --- The counting strategies ---
+
+// From DataRace.cpp. volatile only stops the compiler from folding the loop into one add;
+// the read-modify-write is still racy and still loses updates.
+volatile long long race_counter = 0;
+
+long long plain_counter = 0; // Mutex.cpp and LockGuard.cpp.
+std::mutex mtx;
+
+std::atomic<long long> atomic_counter = {0}; // Atomic.cpp.
+
+// Compact copy of StripedCounter.cpp: one padded slot per thread, summed on read. Only the
+// owner writes its slot, so a load and a store are enough there. Threads past kSlots share the
+// overflow slot and must use fetch_add: a plain store into a slot someone else owns loses updates.
+class StripedCounter {
+public:
+    static const int kSlots = 64;
+
+    void add_from(int thread_index, long long n) {
+        if (thread_index < kSlots) {
+            Slot& s = slots[thread_index];
+            s.total.store(s.total.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        } else {
+            overflow.total.fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+
+    long long read() const {
+        long long sum = overflow.total.load(std::memory_order_relaxed);
+        for (const Slot& s : slots) {
+            sum += s.total.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    void reset() {
+        for (Slot& s : slots) {
+            s.total.store(0);
+        }
+        overflow.total.store(0);
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<long long> total{0};
+    };
+    Slot slots[kSlots];
+    Slot overflow;
+};
+
+StripedCounter striped_counter;
+
+struct Strategy {
+    const char* name;
+    std::function<void()> reset;
+    std::function<void(int thread_index)> increment;
+    std::function<long long()> value;
+};
+
+// --- The locks from their examples, each around LockGuard.cpp's counter++ ---
+
+TTASLock ttas_lock;
+TicketLock ticket_lock;
+MCSLock mcs_lock;
+CLHLock clh_lock;
+FutexMutex futex_mutex;
+RwLock rw_lock;
+FlatCombining<long long> flat_counter;
+CohortLock cohort_lock(2); // Two simulated sockets: threads are dealt out to them in turn.
+
+// LockGuard.cpp's counter++ under any Lockable.
+template<class Lock>
+Strategy locked(const char* name, Lock& lock) {
+    return {name,
+            [] { plain_counter = 0; },
+            [&lock](int) {
+                std::lock_guard<Lock> guard(lock);
+                plain_counter++;
+            },
+            [] { return plain_counter; }};
+}
+
+std::vector<Strategy> strategies() {
+    return {
+        {"data_race",
+         [] { race_counter = 0; },
+         [](int) {
+             long long temp = race_counter;
+             temp++;
+             race_counter = temp;
+         },
+         [] { return static_cast<long long>(race_counter); }},
+        {"mutex",
+         [] { plain_counter = 0; },
+         [](int) {
+             mtx.lock();
+             long long temp = plain_counter;
+             temp++;
+             plain_counter = temp;
+             mtx.unlock();
+         },
+         [] { return plain_counter; }},
+        {"lock_guard",
+         [] { plain_counter = 0; },
+         [](int) {
+             std::lock_guard<std::mutex> guard(mtx);
+             plain_counter++;
+         },
+         [] { return plain_counter; }},
+        {"atomic",
+         [] { atomic_counter = 0; },
+         [](int) { atomic_counter++; },
+         [] { return atomic_counter.load(); }},
+        {"striped",
+         [] { striped_counter.reset(); },
+         [](int thread_index) { striped_counter.add_from(thread_index, 1); },
+         [] { return striped_counter.read(); }},
+        locked("ttas", ttas_lock),
+        locked("ticket", ticket_lock),
+        locked("mcs", mcs_lock),
+        locked("clh", clh_lock),
+        locked("futex_mutex", futex_mutex),
+        locked("rwlock", rw_lock),
+        {"flat_combine",
+         [] { flat_counter.apply([](long long& c) { c = 0; }); },
+         [](int) { flat_counter.apply([](long long& c) { ++c; }); },
+         [] { return flat_counter.apply([](long long& c) { return c; }); }},
+        locked("cohort(2)", cohort_lock),
+    };
+}
+
+// --- One run ---
+
+struct Result {
+    double ns_per_op;
+    double fairness;      // min/max of per-thread ops.
+    double cycles_per_op; // < 0 when unavailable.
+    double misses_per_op;
+    bool correct;
+};
+
+Result run(const Strategy& s, int threads, std::chrono::milliseconds duration) {
+    s.reset();
+    std::vector<long long> ops(threads, 0);
+    std::atomic<bool> go{false}, stop{false};
+    std::atomic<int> ready{0};
+
+    PerfCounter cycles(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    PerfCounter misses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    cycles.start();
+    misses.start();
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            ++ready;
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            long long n = 0;
+            // Check the stop flag every 64 increments, so the check itself stays out of the numbers.
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (int i = 0; i < 64; ++i) {
+                    s.increment(t);
+                }
+                n += 64;
+            }
+            ops[t] = n;
+        });
+    }
+    while (ready.load() < threads) {
+        std::this_thread::yield();
+    }
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (std::thread& w : workers) {
+        w.join();
+    }
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    long long c = cycles.stop();
+    long long m = misses.stop();
+
+    long long total = 0;
+    for (long long n : ops) {
+        total += n;
+    }
+    auto [lo, hi] = std::minmax_element(ops.begin(), ops.end());
+    Result r;
+    r.ns_per_op = ns / static_cast<double>(total);
+    r.fairness = *hi > 0 ? static_cast<double>(*lo) / static_cast<double>(*hi) : 0;
+    r.cycles_per_op = c >= 0 ? static_cast<double>(c) / static_cast<double>(total) : -1;
+    r.misses_per_op = m >= 0 ? static_cast<double>(m) / static_cast<double>(total) : -1;
+    r.correct = s.value() == total;
+    return r;
+}
+
+int main(int argc, char* argv[]) {
+    std::chrono::milliseconds duration(argc > 1 ? std::stoi(argv[1]) : 200);
+    bool perf = PerfCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES).available();
+    std::cout << "Benchmark: " << duration.count() << " ms per run, " << std::thread::hardware_concurrency()
+              << " hardware threads, perf counters " << (perf ? "available" : "unavailable") << std::endl;
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-12s %7s %9s %9s %12s %12s  %s", "strategy", "threads", "ns/op",
+                  "min/max", "cycles/op", "misses/op", "count");
+    std::cout << line << std::endl;
+    for (const Strategy& s : strategies()) {
+        for (int threads : {1, 2, 4, 8, 16}) {
+            Result r = run(s, threads, duration);
+            char cycles[32] = "n/a", misses[32] = "n/a";
+            if (r.cycles_per_op >= 0) {
+                std::snprintf(cycles, sizeof(cycles), "%.1f", r.cycles_per_op);
+            }
+            if (r.misses_per_op >= 0) {
+                std::snprintf(misses, sizeof(misses), "%.3f", r.misses_per_op);
+            }
+            std::snprintf(line, sizeof(line), "%-12s %7d %9.2f %9.2f %12s %12s  %s", s.name, threads, r.ns_per_op,
+                          r.fairness, cycles, misses, r.correct ? "ok" : "LOST UPDATES");
+            std::cout << line << std::endl;
+        }
+    }
+    return 0;
+}
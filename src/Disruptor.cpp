@@ -0,0 +1,375 @@
+// A Disruptor-style multicast ring buffer (after LMAX's Disruptor).
+// In ConsumerProducer.cpp every message is popped by exactly one consumer. Here every consumer
+// sees every message, each at its own pace, and nobody copies the message:
+//   - The ring is pre-allocated once. The producer claims a sequence number, fills the event in
+//     place and publishes it by advancing the `cursor`.
+//   - Each consumer owns a `Sequence`: the last event it has finished with. Consumers read
+//     events straight out of the ring.
+//   - A consumer waits on a `SequenceBarrier`: "the cursor, and every consumer I depend on, have
+//     reached sequence N". That is how dependency chains are expressed, e.g. a diamond where C1 and
+//     C2 run in parallel and C3 only sees an event after both are done with it.
+//   - The producer may only overwrite a slot once the consumers at the end of every chain (the
+//     "gating" sequences) have moved past it.
+//   - Once a consumer wakes up it processes everything that's available and publishes its own
+//     sequence once for the whole batch, so it catches up quickly after falling behind.
+// How a thread waits for a sequence is pluggable: busy spin (lowest latency, burns a core),
+// yield (spin a little, then give up the time slice) or block (mutex + condition variable).
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <string>
+
+// A sequence number on its own cache line, so consumers don't slow each other down.
+struct alignas(64) Sequence {
+    std::atomic<long long> value{-1};
+
+    long long get() const { return value.load(std::memory_order_acquire); }
+    void set(long long v) { value.store(v, std::memory_order_release); }
+};
+
+long long min_sequence(const std::vector<const Sequence*>& sequences, long long upper) {
+    long long m = upper;
+    for (const Sequence* s : sequences) {
+        m = std::min(m, s->get());
+    }
+    return m;
+}
+
+// --- Wait strategies ---
+// wait_for() returns the highest sequence that is available (>= seq), i.e. the minimum of the
+// cursor and of all dependencies. signal_all() is called by the producer after each publish.
+
+struct BusySpinWait {
+    long long wait_for(long long seq, const Sequence& cursor, const std::vector<const Sequence*>& deps) {
+        long long available;
+        while ((available = min_sequence(deps, cursor.get())) < seq) {
+            // Burn the CPU: the event is picked up the moment it is published.
+        }
+        return available;
+    }
+    void signal_all() {}
+};
+
+struct YieldingWait {
+    long long wait_for(long long seq, const Sequence& cursor, const std::vector<const Sequence*>& deps) {
+        long long available;
+        int spins = 100;
+        while ((available = min_sequence(deps, cursor.get())) < seq) {
+            if (--spins <= 0) {
+                std::this_thread::yield();
+            }
+        }
+        return available;
+    }
+    void signal_all() {}
+};
+
+struct BlockingWait {
+    long long wait_for(long long seq, const Sequence& cursor, const std::vector<const Sequence*>& deps) {
+        if (cursor.get() < seq) {
+            std::unique_lock<std::mutex> lock(mtx);
+            waiters.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            cv.wait(lock, [&] { return cursor.get() >= seq; });
+            waiters.fetch_sub(1);
+        }
+        // The producer is the only one who signals. Consumers we depend on are normally close behind
+        // the cursor, so for them a short yield loop is enough.
+        long long available;
+        while ((available = min_sequence(deps, cursor.get())) < seq) {
+            std::this_thread::yield();
+        }
+        return available;
+    }
+    void signal_all() {
+        // Only pay for the lock and the notify when somebody is actually asleep.
+        // The fences pair up (store cursor / fence / load waiters vs. add waiter / fence / load cursor),
+        // so at least one side sees the other and no wakeup is lost.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) > 0) {
+            { std::lock_guard<std::mutex> guard(mtx); }
+            cv.notify_all();
+        }
+    }
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::atomic<int> waiters{0};
+};
+
+template<class T, class Wait>
+class RingBuffer;
+
+// What a consumer waits on: the producer's cursor plus the sequences of the consumers before it.
+template<class T, class Wait>
+class SequenceBarrier {
+public:
+    SequenceBarrier(RingBuffer<T, Wait>& ring, std::vector<const Sequence*> deps)
+        : ring(ring), deps(std::move(deps)) {}
+
+    long long wait_for(long long seq) { return ring.wait.wait_for(seq, ring.cursor, deps); }
+
+private:
+    RingBuffer<T, Wait>& ring;
+    std::vector<const Sequence*> deps;
+};
+
+// Single-producer ring. Events are constructed once, up front, and reused forever.
+template<class T, class Wait>
+class RingBuffer {
+public:
+    explicit RingBuffer(size_t min_size) {
+        size_t size = 1;
+        while (size < min_size) {
+            size <<= 1;
+        }
+        mask = size - 1;
+        events.resize(size);
+    }
+
+    // The sequences of the last consumer in every chain. The producer never laps them.
+    void set_gating_sequences(std::vector<const Sequence*> sequences) { gating = std::move(sequences); }
+
+    SequenceBarrier<T, Wait> new_barrier(std::vector<const Sequence*> deps = {}) {
+        return SequenceBarrier<T, Wait>(*this, std::move(deps));
+    }
+
+    // Claims the next slot, waiting if that would overwrite an event somebody still needs.
+    long long next() {
+        long long seq = ++claimed;
+        long long wrap_point = seq - static_cast<long long>(mask + 1);
+        if (wrap_point > cached_gating) {
+            while ((cached_gating = min_sequence(gating, seq - 1)) < wrap_point) {
+                std::this_thread::yield();
+            }
+        }
+        return seq;
+    }
+
+    T& operator[](long long seq) { return events[seq & mask]; }
+
+    // Makes everything up to and including seq visible to the consumers.
+    void publish(long long seq) {
+        cursor.set(seq);
+        wait.signal_all();
+    }
+
+private:
+    friend class SequenceBarrier<T, Wait>;
+
+    Sequence cursor;
+    Wait wait;
+    std::vector<T> events;
+    size_t mask;
+    std::vector<const Sequence*> gating;
+    long long claimed = -1;        // Producer-private.
+    long long cached_gating = -1;  // Producer-private.
+};
+
+// The consumer loop: wait for a batch, handle each event in place, then publish our progress once.
+template<class T, class Wait, class Handler>
+void run_consumer(SequenceBarrier<T, Wait> barrier, RingBuffer<T, Wait>& ring, Sequence& sequence,
+                  long long last_seq, Handler handler) {
+    long long next = sequence.get() + 1;
+    while (next <= last_seq) {
+        long long available = std::min(barrier.wait_for(next), last_seq);
+        for (; next <= available; ++next) {
+            handler(ring[next], next);
+        }
+        sequence.set(available);
+    }
+}
+
+// --- Example: a diamond. C1 and C2 each see every event; C3 only after both are done with it ---
+
+struct Trade {
+    long long id = 0;
+    long long price = 0;
+    long long journaled = -1;  // Written by C1.
+    long long replicated = -1; // Written by C2.
+};
+
+void example() {
+    const long long kEvents = 100000;
+    RingBuffer<Trade, YieldingWait> ring(256);
+    Sequence c1_seq, c2_seq, c3_seq;
+    ring.set_gating_sequences({&c3_seq}); // C3 is at the end of both chains.
+
+    long long c3_ok = 0;
+    std::thread c1([&] {
+        run_consumer(ring.new_barrier(), ring, c1_seq, kEvents - 1,
+                     [](Trade& t, long long) { t.journaled = t.id; });
+    });
+    std::thread c2([&] {
+        run_consumer(ring.new_barrier(), ring, c2_seq, kEvents - 1,
+                     [](Trade& t, long long) { t.replicated = t.id; });
+    });
+    std::thread c3([&] {
+        run_consumer(ring.new_barrier({&c1_seq, &c2_seq}), ring, c3_seq, kEvents - 1,
+                     [&c3_ok](Trade& t, long long seq) {
+                         // Both upstream consumers have finished with this very object.
+                         if (t.id == seq && t.journaled == seq && t.replicated == seq) {
+                             ++c3_ok;
+                         }
+                     });
+    });
+
+    for (long long i = 0; i < kEvents; ++i) {
+        long long seq = ring.next();
+        Trade& t = ring[seq]; // Written in place: no allocation, no copy.
+        t.id = seq;
+        t.price = 100 + seq % 7;
+        t.journaled = -1;
+        t.replicated = -1;
+        ring.publish(seq);
+    }
+    c1.join();
+    c2.join();
+    c3.join();
+    std::cout << "Diamond: C3 saw " << c3_ok << "/" << kEvents
+              << " trades already journaled by C1 and replicated by C2" << std::endl;
+}
+
+// --- Benchmark: fan-out to K consumers, Disruptor vs one mutex+cv queue per consumer ---
+
+struct Tick {
+    long long seq = 0;
+    long long sent_ns = 0;
+};
+
+long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Result {
+    double msgs_per_sec;
+    std::vector<long long> latencies; // Of consumer 0.
+    bool ok;
+};
+
+template<class Wait>
+Result bench_disruptor(long long n, int consumers) {
+    RingBuffer<Tick, Wait> ring(1024);
+    std::vector<Sequence> sequences(consumers);
+    std::vector<const Sequence*> gating;
+    for (const Sequence& s : sequences) {
+        gating.push_back(&s);
+    }
+    ring.set_gating_sequences(gating);
+
+    Result r{0, {}, true};
+    r.latencies.reserve(n);
+    std::vector<long long> checksums(consumers, 0);
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int c = 0; c < consumers; ++c) {
+        threads.emplace_back([&, c] {
+            run_consumer(ring.new_barrier(), ring, sequences[c], n - 1,
+                         [&, c](Tick& t, long long) {
+                             if (c == 0) {
+                                 r.latencies.push_back(now_ns() - t.sent_ns);
+                             }
+                             checksums[c] += t.seq;
+                         });
+        });
+    }
+    for (long long i = 0; i < n; ++i) {
+        long long seq = ring.next();
+        ring[seq] = {seq, now_ns()};
+        ring.publish(seq);
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    r.msgs_per_sec = n / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (long long sum : checksums) {
+        r.ok = r.ok && sum == n * (n - 1) / 2;
+    }
+    return r;
+}
+
+// The obvious alternative: the producer copies every message into a private queue per consumer.
+Result bench_queues(long long n, int consumers) {
+    struct Channel {
+        std::queue<Tick> q;
+        std::mutex mtx;
+        std::condition_variable cv;
+    };
+    std::vector<Channel> channels(consumers);
+
+    Result r{0, {}, true};
+    r.latencies.reserve(n);
+    std::vector<long long> checksums(consumers, 0);
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int c = 0; c < consumers; ++c) {
+        threads.emplace_back([&, c] {
+            Channel& ch = channels[c];
+            for (long long received = 0; received < n; ++received) {
+                std::unique_lock<std::mutex> lock(ch.mtx);
+                ch.cv.wait(lock, [&ch] { return !ch.q.empty(); });
+                Tick t = ch.q.front();
+                ch.q.pop();
+                lock.unlock();
+                if (c == 0) {
+                    r.latencies.push_back(now_ns() - t.sent_ns);
+                }
+                checksums[c] += t.seq;
+            }
+        });
+    }
+    for (long long i = 0; i < n; ++i) {
+        Tick t{i, now_ns()};
+        for (Channel& ch : channels) {
+            {
+                std::lock_guard<std::mutex> guard(ch.mtx);
+                ch.q.push(t);
+            }
+            ch.cv.notify_one();
+        }
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    r.msgs_per_sec = n / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (long long sum : checksums) {
+        r.ok = r.ok && sum == n * (n - 1) / 2;
+    }
+    return r;
+}
+
+void report(const std::string& name, Result r) {
+    std::sort(r.latencies.begin(), r.latencies.end());
+    auto pct = [&r](double p) { return r.latencies[static_cast<size_t>(p * (r.latencies.size() - 1))]; };
+    std::cout << name << ": " << static_cast<long long>(r.msgs_per_sec) << " msgs/s to every consumer, latency p50 "
+              << pct(0.50) << " ns, p99 " << pct(0.99) << " ns" << (r.ok ? "" : "  (CHECKSUM ERROR)") << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    example();
+
+    long long n = argc > 1 ? std::stoll(argv[1]) : 1000000;
+    const int consumers = 3;
+    std::cout << "\nBenchmark: 1 producer -> " << consumers << " consumers, each sees all "
+              << n << " messages" << std::endl;
+    report("Per-consumer queues    ", bench_queues(n, consumers));
+    report("Disruptor, blocking    ", bench_disruptor<BlockingWait>(n, consumers));
+    report("Disruptor, yielding    ", bench_disruptor<YieldingWait>(n, consumers));
+    // Busy spinning needs a core per spinning thread, or it just burns the time slices the
+    // producer needs.
+    if (std::thread::hardware_concurrency() > static_cast<unsigned>(consumers)) {
+        report("Disruptor, busy spin   ", bench_disruptor<BusySpinWait>(n, consumers));
+    } else {
+        std::cout << "Disruptor, busy spin   : skipped, needs more than " << consumers << " cores" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,312 @@
+// False sharing: padded containers for per-thread data, and a debug-mode detector.
+// ThreadLocal.cpp gives each thread its own `thread_local int counter`. Code that wants to add
+// up all the threads' counts afterwards usually puts them in an array instead:
+//     long long counts[kThreads];   // thread t only ever touches counts[t]
+// No two threads write the same variable, so there's no data race, but eight long longs share
+// one 64-byte cache line. Caches move whole lines: every increment takes the line away from the
+// other cores, and the counters slow down as if they were one contended atomic.
+// That's false sharing. The fix is to give each slot a line of its own:
+//   - cache_aligned<T>: a T aligned (and so padded) to a cache line.
+//   - PerThread<T>: an array of cache_aligned<T>, one per thread, with local() for the calling
+//     thread's slot and for_each() to combine them.
+// Finding the problem is the hard part, since nothing is wrong except the speed. Compile with
+// -DFALSE_SHARING_DEBUG=1 and every NOTE_WRITE(&x) samples one in kSampleEvery of the calling
+// thread's writes: which thread wrote which bytes of which cache line. report() lists the lines
+// that more than one thread wrote, as false sharing (different bytes) or true sharing (the same
+// bytes). It doesn't record when, so clear() it between phases that reuse the same memory from
+// different threads. Without the flag NOTE_WRITE compiles to nothing.
+// On a single-core machine the threads never run at the same time, so there's nothing to slow
+// down: expect the packed and padded columns to match there.
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#ifndef FALSE_SHARING_DEBUG
+#define FALSE_SHARING_DEBUG 0
+#endif
+
+// 64 bytes on x86 and most ARM cores. (std::hardware_destructive_interference_size says the same,
+// but GCC warns that its value may differ between compiler versions.)
+constexpr size_t kCacheLine = 64;
+
+template<class T>
+struct alignas(kCacheLine) cache_aligned {
+    T value{};
+
+    cache_aligned() = default;
+    explicit cache_aligned(const T& v) : value(v) {}
+
+    T& operator*() { return value; }
+    const T& operator*() const { return value; }
+    T* operator->() { return &value; }
+    const T* operator->() const { return &value; }
+};
+
+static_assert(sizeof(cache_aligned<char>) == kCacheLine, "one slot per line");
+static_assert(alignof(cache_aligned<long long>) == kCacheLine, "slots start on a line");
+
+// Hands out small per-thread indices (as in StripedCounter.cpp), reused after threads exit.
+class ThreadIndex {
+public:
+    static const int kMaxThreads = 128;
+
+    static int get() {
+        thread_local Holder holder;
+        return holder.index;
+    }
+
+private:
+    struct Holder {
+        int index = -1;
+        Holder() {
+            for (int i = 0; i < kMaxThreads; ++i) {
+                bool expected = false;
+                if (taken()[i].compare_exchange_strong(expected, true)) {
+                    index = i;
+                    return;
+                }
+            }
+            throw std::runtime_error("ThreadIndex: too many threads");
+        }
+        ~Holder() { taken()[index].store(false); }
+    };
+
+    static std::atomic<bool>* taken() {
+        static std::atomic<bool> flags[kMaxThreads] = {};
+        return flags;
+    }
+};
+
+// One padded T per thread.
+template<class T>
+class PerThread {
+public:
+    explicit PerThread(size_t slots = ThreadIndex::kMaxThreads) : slots(slots) {}
+
+    // The calling thread's slot.
+    T& local() { return slots.at(ThreadIndex::get()).value; }
+
+    T& operator[](size_t i) { return slots[i].value; }
+    const T& operator[](size_t i) const { return slots[i].value; }
+    size_t size() const { return slots.size(); }
+
+    template<class F>
+    void for_each(F f) const {
+        for (const cache_aligned<T>& s : slots) {
+            f(s.value);
+        }
+    }
+
+private:
+    std::vector<cache_aligned<T>> slots; // operator new honours the alignment since C++17.
+};
+
+// --- Debug mode: sample written addresses and flag cache lines written by several threads ---
+
+#if FALSE_SHARING_DEBUG
+
+class SharingDetector {
+public:
+    static constexpr int kSampleEvery = 256;
+
+    static SharingDetector& instance() {
+        static SharingDetector d;
+        return d;
+    }
+
+    // Names the bytes [begin, begin + bytes) in the report.
+    void label(const void* begin, size_t bytes, std::string name) {
+        std::lock_guard<std::mutex> guard(mtx);
+        labels.push_back({reinterpret_cast<uintptr_t>(begin), bytes, std::move(name)});
+    }
+
+    void note_write(const void* addr, size_t bytes) {
+        thread_local int countdown = 0;
+        if (--countdown > 0) {
+            return;
+        }
+        countdown = kSampleEvery;
+        thread_local int thread = next_thread.fetch_add(1);
+        uintptr_t a = reinterpret_cast<uintptr_t>(addr);
+        std::lock_guard<std::mutex> guard(mtx);
+        Line& line = lines[a / kCacheLine];
+        ++line.samples;
+        int offset = static_cast<int>(a % kCacheLine);
+        for (Writer& w : line.writers) {
+            if (w.thread == thread) {
+                w.first = std::min(w.first, offset);
+                w.last = std::max(w.last, offset + static_cast<int>(bytes) - 1);
+                return;
+            }
+        }
+        line.writers.push_back({thread, offset, offset + static_cast<int>(bytes) - 1});
+    }
+
+    // Lines written by more than one thread, most sampled first.
+    void report(std::ostream& out) {
+        std::lock_guard<std::mutex> guard(mtx);
+        std::vector<std::pair<uintptr_t, const Line*>> shared;
+        for (auto& l : lines) {
+            if (l.second.writers.size() > 1) {
+                shared.emplace_back(l.first, &l.second);
+            }
+        }
+        std::sort(shared.begin(), shared.end(), [](auto& a, auto& b) { return a.second->samples > b.second->samples; });
+        out << "Cache lines written by more than one thread (1 in " << kSampleEvery << " writes sampled): "
+            << shared.size() << std::endl;
+        for (auto& [line_no, line] : shared) {
+            bool overlap = false;
+            for (size_t i = 0; i < line->writers.size(); ++i) {
+                for (size_t j = i + 1; j < line->writers.size(); ++j) {
+                    const Writer& a = line->writers[i];
+                    const Writer& b = line->writers[j];
+                    overlap |= a.first <= b.last && b.first <= a.last;
+                }
+            }
+            uintptr_t addr = line_no * kCacheLine;
+            char text[128];
+            std::snprintf(text, sizeof(text), "  line 0x%llx %-24s %-13s %zu threads, %lld samples:",
+                          static_cast<unsigned long long>(addr), name_of(addr).c_str(),
+                          overlap ? "TRUE sharing" : "FALSE sharing", line->writers.size(), line->samples);
+            out << text;
+            for (const Writer& w : line->writers) {
+                out << " t" << w.thread << "@[" << w.first << "," << w.last << "]";
+            }
+            out << std::endl;
+        }
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> guard(mtx);
+        lines.clear();
+    }
+
+private:
+    struct Writer {
+        int thread;
+        int first, last; // Byte offsets within the line.
+    };
+    struct Line {
+        std::vector<Writer> writers;
+        long long samples = 0;
+    };
+    struct Label {
+        uintptr_t begin;
+        size_t bytes;
+        std::string name;
+    };
+
+    std::string name_of(uintptr_t line_addr) const {
+        for (const Label& l : labels) {
+            if (line_addr + kCacheLine > l.begin && line_addr < l.begin + l.bytes) {
+                return "(" + l.name + ")";
+            }
+        }
+        return "";
+    }
+
+    std::mutex mtx;
+    std::unordered_map<uintptr_t, Line> lines;
+    std::vector<Label> labels;
+    std::atomic<int> next_thread{0};
+};
+
+#define NOTE_WRITE(p) SharingDetector::instance().note_write((p), sizeof(*(p)))
+
+#else
+
+#define NOTE_WRITE(p) ((void)0)
+
+#endif
+
+// --- Benchmark: per-thread counters, packed vs padded ---
+
+// Each thread bumps its own counter `per_thread` times. The counters are relaxed atomics so the
+// compiler can't keep them in a register: every increment really writes memory, like a counter
+// that other threads read while it's running.
+template<class Slot>
+double ns_per_op(int threads, long long per_thread, Slot slot) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::atomic<long long>& c = slot(t);
+            for (long long i = 0; i < per_thread; ++i) {
+                c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                NOTE_WRITE(&c);
+            }
+        });
+    }
+    for (std::thread& w : workers) {
+        w.join();
+    }
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    return ns / static_cast<double>(threads * per_thread);
+}
+
+int main(int argc, char* argv[]) {
+    long long per_thread = argc > 1 ? std::stoll(argv[1]) : 20000000;
+    const int kThreads = 16;
+
+    std::atomic<long long> packed[kThreads] = {};
+    PerThread<std::atomic<long long>> padded(kThreads);
+#if FALSE_SHARING_DEBUG
+    SharingDetector::instance().label(packed, sizeof(packed), "packed[]");
+    SharingDetector::instance().label(&padded[0], kThreads * kCacheLine, "PerThread");
+#endif
+
+    std::cout << "Benchmark: " << per_thread << " increments per thread, " << std::thread::hardware_concurrency()
+              << " hardware threads" << (FALSE_SHARING_DEBUG ? ", with the sharing detector on" : "") << std::endl;
+    std::cout << "threads   packed ns/op   padded ns/op   slowdown" << std::endl;
+    for (int threads : {1, 2, 4, 8, 16}) {
+        double p = ns_per_op(threads, per_thread, [&](int t) -> std::atomic<long long>& { return packed[t]; });
+        double q = ns_per_op(threads, per_thread, [&](int t) -> std::atomic<long long>& { return padded[t]; });
+        char line[96];
+        std::snprintf(line, sizeof(line), "%7d %14.2f %14.2f %9.2fx", threads, p, q, p / q);
+        std::cout << line << std::endl;
+    }
+
+    // local() picks the slot by thread, so the same code works for any number of threads.
+    PerThread<long long> counts;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; ++t) {
+        workers.emplace_back([&counts] {
+            for (int i = 0; i < 1000; ++i) {
+                counts.local()++;
+            }
+        });
+    }
+    for (std::thread& w : workers) {
+        w.join();
+    }
+    long long total = 0;
+    counts.for_each([&total](long long c) { total += c; });
+    std::cout << "PerThread<long long>::local(), 4 threads x 1000: total " << total << std::endl;
+
+#if FALSE_SHARING_DEBUG
+    // The detector can't tell threads that ran one after another from threads that ran at the
+    // same time, so look at one run at a time.
+    SharingDetector& detector = SharingDetector::instance();
+    detector.clear();
+    ns_per_op(4, per_thread, [&](int t) -> std::atomic<long long>& { return packed[t]; });
+    std::cout << "4 threads on packed[]. ";
+    detector.report(std::cout);
+    detector.clear();
+    ns_per_op(4, per_thread, [&](int t) -> std::atomic<long long>& { return padded[t]; });
+    std::cout << "4 threads on PerThread. ";
+    detector.report(std::cout);
+#else
+    std::cout << "Compile with -DFALSE_SHARING_DEBUG=1 to list the cache lines several threads wrote." << std::endl;
+#endif
+    return 0;
+}
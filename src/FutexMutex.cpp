@@ -0,0 +1,270 @@
+// An adaptive futex mutex: spins briefly when that's likely to pay off, otherwise sleeps in the
+// kernel. A drop-in replacement for std::mutex in Mutex.cpp, LockGuard.cpp and ThreadPool.
+// The lock is one int with three states (Ulrich Drepper, "Futexes Are Tricky"):
+//     0 = unlocked, 1 = locked, 2 = locked and somebody may be sleeping on it.
+//   - lock() with no contention: one CAS 0 -> 1. No system call.
+//   - unlock() with no contention: 1 -> 0, and nobody needs waking. No system call.
+//   - A thread that has to sleep first sets the word to 2 and then calls futex(FUTEX_WAIT), which
+//     only sleeps if the word is still 2. unlock() seeing 2 knows it has to call futex(FUTEX_WAKE).
+// Before sleeping, a waiter spins for a while, because a sleep + wake costs two system calls and
+// two context switches, far more than a short critical section. How long to spin is learned:
+//   - Every time spinning got the lock, the number of spins it took goes into a running average:
+//     that is roughly how long the lock is held.
+//   - Every time spinning gave up, the average decays: holds are too long to wait out.
+//   - The spin budget is twice the average plus a small floor, so the lock keeps probing and can
+//     learn that holds have become short again.
+//   - A waiter doesn't spin at all when the word is already 2: others are asleep, so the holder
+//     has been busy for a while and the lock is heavily contended. Nor on a single-CPU machine,
+//     where the holder can't be running while we spin.
+//   - Spinning only pays while the holder is running. Every acquisition records the holder's CPU
+//     (sched_getcpu(), a few ns), and a waiter on that same CPU stops spinning: the holder was
+//     preempted by us. A holder preempted on *another* CPU can't be detected from user space
+//     (/proc shows running and runnable threads alike as 'R', and nothing cheaper reports
+//     "on CPU"), so there it's the learned budget that limits the wasted spinning.
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <queue>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <type_traits>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/futex.h>
+#include "locks/FutexMutex.h"
+
+// --- glibc's mutexes as Lockables, for comparison ---
+
+class PthreadMutex {
+public:
+    explicit PthreadMutex(bool adaptive = false) {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+#ifdef PTHREAD_ADAPTIVE_MUTEX_INITIALIZER_NP
+        if (adaptive) {
+            pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ADAPTIVE_NP);
+        }
+#else
+        (void)adaptive;
+#endif
+        pthread_mutex_init(&m, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+    ~PthreadMutex() { pthread_mutex_destroy(&m); }
+
+    void lock() { pthread_mutex_lock(&m); }
+    bool try_lock() { return pthread_mutex_trylock(&m) == 0; }
+    void unlock() { pthread_mutex_unlock(&m); }
+
+private:
+    pthread_mutex_t m;
+};
+
+class AdaptivePthreadMutex : public PthreadMutex {
+public:
+    AdaptivePthreadMutex() : PthreadMutex(true) {}
+};
+
+// --- ThreadPool.cpp's pool, with the mutex type as a parameter ---
+// A custom mutex needs std::condition_variable_any; std::mutex keeps std::condition_variable.
+
+template<class Mutex>
+class ThreadPool {
+public:
+    ThreadPool(size_t num_threads) : stop(false) {
+        for (size_t i = 0; i < num_threads; ++i) {
+            workers.emplace_back([this] {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<Mutex> lock(this->queue_mutex);
+                        this->condition.wait(lock, [this] { return this->stop || !this->tasks.empty(); });
+                        if (this->stop && this->tasks.empty()) {
+                            return;
+                        }
+                        task = std::move(this->tasks.front());
+                        this->tasks.pop();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    template<class F, class... Args>
+    auto submit(F&& f, Args&&... args) -> std::future<decltype(f(args...))> {
+        using return_type = decltype(f(args...));
+        auto task = std::make_shared<std::packaged_task<return_type()>>(
+            std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+        std::future<return_type> res = task->get_future();
+        {
+            std::unique_lock<Mutex> lock(queue_mutex);
+            if (stop) {
+                throw std::runtime_error("submit on stopped ThreadPool");
+            }
+            tasks.emplace([task]() { (*task)(); });
+        }
+        condition.notify_one();
+        return res;
+    }
+
+    ~ThreadPool() {
+        {
+            std::unique_lock<Mutex> lock(queue_mutex);
+            stop = true;
+        }
+        condition.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+
+    Mutex queue_mutex;
+    std::conditional_t<std::is_same<Mutex, std::mutex>::value, std::condition_variable, std::condition_variable_any>
+        condition;
+    bool stop;
+};
+
+// --- Examples: Mutex.cpp and LockGuard.cpp with FutexMutex ---
+
+long long counter = 0;
+FutexMutex mtx;
+
+void increment_mutex() { // Mutex.cpp
+    for (int i = 0; i < 100000; ++i) {
+        mtx.lock();
+        long long temp = counter;
+        temp++;
+        counter = temp;
+        mtx.unlock();
+    }
+}
+
+void increment_lock_guard() { // LockGuard.cpp
+    for (int i = 0; i < 100000; ++i) {
+        std::lock_guard<FutexMutex> guard(mtx);
+        counter++;
+    }
+}
+
+// --- Benchmark ---
+
+long long shared_counter = 0;
+unsigned long long shared_state = 1;
+
+struct Result {
+    double ns_per_op;
+    long long switches;
+    bool correct;
+};
+
+// `work` LCG steps inside the lock, `outside` steps between acquisitions.
+template<class Lock>
+Result run(int threads, int work, int outside, long long per_thread) {
+    Lock lock;
+    shared_counter = 0;
+    rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            unsigned long long local = 1;
+            for (long long i = 0; i < per_thread; ++i) {
+                for (int k = 0; k < outside; ++k) {
+                    local = local * 6364136223846793005ULL + 1;
+                }
+                std::lock_guard<Lock> guard(lock);
+                for (int k = 0; k < work; ++k) {
+                    shared_state = shared_state * 6364136223846793005ULL + local;
+                }
+                shared_counter++;
+            }
+        });
+    }
+    for (std::thread& w : workers) {
+        w.join();
+    }
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    getrusage(RUSAGE_SELF, &after);
+    return {ns / static_cast<double>(threads * per_thread),
+            (after.ru_nvcsw - before.ru_nvcsw) + (after.ru_nivcsw - before.ru_nivcsw),
+            shared_counter == threads * per_thread};
+}
+
+template<class Lock>
+void report(const char* name, int threads, int work, int outside, long long per_thread) {
+    long long calls_before = futex_calls.load();
+    Result r = run<Lock>(threads, work, outside, per_thread);
+    char line[160];
+    std::snprintf(line, sizeof(line), "  %-22s %9.1f ns/op %9lld context switches", name, r.ns_per_op, r.switches);
+    std::cout << line;
+    if (std::is_same<Lock, FutexMutex>::value) {
+        std::cout << "  (" << futex_calls.load() - calls_before << " futex calls)";
+    }
+    std::cout << (r.correct ? "" : "  WRONG COUNT") << std::endl;
+}
+
+template<class Mutex>
+double pool_tasks_per_sec(int tasks) {
+    std::atomic<int> done{0};
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool<Mutex> pool(4);
+        for (int i = 0; i < tasks; ++i) {
+            pool.submit([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+        }
+    }
+    return tasks / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    long long per_thread = argc > 1 ? std::stoll(argv[1]) : 200000;
+
+    std::thread t1(increment_mutex), t2(increment_lock_guard);
+    t1.join();
+    t2.join();
+    std::cout << "Mutex.cpp + LockGuard.cpp with FutexMutex, final counter value: " << counter << std::endl;
+
+    ThreadPool<FutexMutex> pool(4);
+    auto sum = pool.submit([](int x, int y) { return x + y; }, 5, 3);
+    std::cout << "ThreadPool<FutexMutex>: 5 + 3 = " << sum.get() << std::endl;
+
+    std::cout << "Benchmark: " << per_thread << " lock/unlock per thread, " << std::thread::hardware_concurrency()
+              << " hardware threads" << std::endl;
+    struct { int work, outside; const char* what; } shapes[] = {
+        {0, 0, "counter++ only, back to back"},
+        {10, 50, "short hold, some work outside"},
+        {300, 300, "long hold"},
+    };
+    for (auto& s : shapes) {
+        for (int threads : {1, 2, 4, 8}) {
+            std::cout << threads << " threads, " << s.what << std::endl;
+            report<PthreadMutex>("pthread_mutex", threads, s.work, s.outside, per_thread);
+            report<AdaptivePthreadMutex>("pthread_mutex adaptive", threads, s.work, s.outside, per_thread);
+            report<FutexMutex>("FutexMutex", threads, s.work, s.outside, per_thread);
+        }
+    }
+
+    int tasks = 200000;
+    std::cout << "ThreadPool, 4 workers, " << tasks << " empty tasks:" << std::endl;
+    std::cout << "  std::mutex: " << static_cast<long long>(pool_tasks_per_sec<std::mutex>(tasks)) << " tasks/s"
+              << std::endl;
+    std::cout << "  FutexMutex: " << static_cast<long long>(pool_tasks_per_sec<FutexMutex>(tasks)) << " tasks/s"
+              << std::endl;
+    return 0;
+}
@@ -0,0 +1,431 @@
+// Enqueue-to-dequeue latency tracing for a producer/consumer queue.
+// ConsumerProducer.cpp can't tell how long a packet sat in data_queue before consumer() got to
+// it, or how long processing it took. This adds that, cheaply enough to leave on in production:
+//   - Optional per-message timestamps. push() stamps the message, pop() measures its queue
+//     residence time, and a ProcessTimer around the work measures processing time.
+//   - Clock: the TSC (rdtsc, a few ns) for every stamp, calibrated once against steady_clock so
+//     the exporter can turn ticks back into nanoseconds. On CPUs without a TSC we fall back to
+//     steady_clock for the stamps too.
+//   - Lock-free per-thread histograms. Each thread records into its own slot with plain relaxed
+//     loads and stores (no atomic read-modify-write, no shared cache lines). Buckets are
+//     log-linear: 8 per power of two, so any value lands in a bucket within 12.5% of it.
+//   - Queue-depth high-water mark, updated with a CAS only when a new maximum is reached.
+//   - A periodic exporter thread that merges all threads' histograms and prints the percentiles
+//     of each interval.
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <stdexcept>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+// --- Clock: TSC stamps, calibrated against steady_clock ---
+
+class TraceClock {
+public:
+    static uint64_t now() {
+#ifdef HAVE_TSC
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    // Measures how many ticks go by per nanosecond of steady_clock time.
+    static void calibrate() {
+#ifdef HAVE_TSC
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t c0 = now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        auto t1 = std::chrono::steady_clock::now();
+        uint64_t c1 = now();
+        double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        ns_per_tick = ns / static_cast<double>(c1 - c0);
+#endif
+    }
+
+    static double to_ns(uint64_t ticks) { return static_cast<double>(ticks) * ns_per_tick; }
+
+    static double ns_per_tick;
+};
+
+double TraceClock::ns_per_tick = 1.0;
+
+// --- Histogram ---
+
+class LatencyHistogram {
+public:
+    static constexpr int kBuckets = 16 + 60 * 8;
+
+    // Values below 16 get a bucket each; above that, 8 buckets per power of two.
+    static int bucket_of(uint64_t v) {
+        if (v < 16) {
+            return static_cast<int>(v);
+        }
+        int msb = 63 - __builtin_clzll(v);
+        int sub = static_cast<int>((v >> (msb - 3)) & 7);
+        return 16 + (msb - 4) * 8 + sub;
+    }
+
+    // Smallest value that lands in bucket b.
+    static uint64_t bucket_floor(int b) {
+        if (b < 16) {
+            return static_cast<uint64_t>(b);
+        }
+        int msb = (b - 16) / 8 + 4;
+        uint64_t sub = static_cast<uint64_t>((b - 16) % 8);
+        return (uint64_t(1) << msb) | (sub << (msb - 3));
+    }
+
+    // Only the owning thread calls this, so a relaxed load and store are enough: readers may
+    // see a slightly stale count, never a torn one.
+    void record(uint64_t v) {
+        bump(buckets[bucket_of(v)], 1);
+        if (v > max.load(std::memory_order_relaxed)) {
+            max.store(v, std::memory_order_relaxed);
+        }
+    }
+
+    std::atomic<uint64_t> buckets[kBuckets] = {};
+    std::atomic<uint64_t> max{0};
+
+private:
+    static void bump(std::atomic<uint64_t>& a, uint64_t by) {
+        a.store(a.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+};
+
+// A merged, plain copy of histograms, used by the exporter.
+struct Snapshot {
+    uint64_t buckets[LatencyHistogram::kBuckets] = {};
+    uint64_t max = 0;
+
+    void add(const LatencyHistogram& h) {
+        for (int b = 0; b < LatencyHistogram::kBuckets; ++b) {
+            buckets[b] += h.buckets[b].load(std::memory_order_relaxed);
+        }
+        max = std::max(max, h.max.load(std::memory_order_relaxed));
+    }
+
+    uint64_t count() const {
+        uint64_t n = 0;
+        for (uint64_t c : buckets) {
+            n += c;
+        }
+        return n;
+    }
+
+    // In nanoseconds. Counts between the bucket floors are reported as the floor.
+    double percentile(double p) const {
+        uint64_t n = count();
+        if (n == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(n - 1));
+        uint64_t seen = 0;
+        for (int b = 0; b < LatencyHistogram::kBuckets; ++b) {
+            seen += buckets[b];
+            if (seen > rank) {
+                return TraceClock::to_ns(LatencyHistogram::bucket_floor(b));
+            }
+        }
+        return TraceClock::to_ns(max);
+    }
+};
+
+// --- Per-thread registry ---
+
+struct alignas(64) ThreadStats {
+    LatencyHistogram residence;  // Enqueue -> dequeue.
+    LatencyHistogram processing; // Dequeue -> done.
+    uint64_t last_dequeue = 0;   // Owner-only: doubles as the start of processing.
+};
+
+class Tracer {
+public:
+    static constexpr int kMaxThreads = 64;
+
+    std::atomic<bool> enabled{true};
+
+    // The calling thread's slot, claimed on first use. Slots are never given back, so a thread
+    // that exits still counts in the totals.
+    ThreadStats& local() {
+        thread_local ThreadStats* mine = nullptr;
+        if (!mine) {
+            int i = used.fetch_add(1);
+            if (i >= kMaxThreads) {
+                throw std::runtime_error("Tracer: too many threads");
+            }
+            mine = &slots[i];
+        }
+        return *mine;
+    }
+
+    void note_depth(size_t depth) {
+        size_t seen = depth_high_water.load(std::memory_order_relaxed);
+        while (depth > seen && !depth_high_water.compare_exchange_weak(seen, depth, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Merges every thread's histograms. Takes the depth high-water mark and starts a new one.
+    void collect(Snapshot& residence, Snapshot& processing, size_t& high_water) {
+        int n = std::min(used.load(), kMaxThreads);
+        for (int i = 0; i < n; ++i) {
+            residence.add(slots[i].residence);
+            processing.add(slots[i].processing);
+        }
+        high_water = depth_high_water.exchange(0, std::memory_order_relaxed);
+    }
+
+private:
+    ThreadStats slots[kMaxThreads];
+    std::atomic<int> used{0};
+    std::atomic<size_t> depth_high_water{0};
+};
+
+Tracer tracer;
+
+// Times a scope as processing time, if tracing is on. Processing starts when this thread
+// dequeued its last traced message: pop() already read the clock, so we don't read it again.
+class ProcessTimer {
+public:
+    ProcessTimer() {
+        if (tracer.enabled.load(std::memory_order_relaxed)) {
+            stats = &tracer.local();
+            start = stats->last_dequeue ? stats->last_dequeue : TraceClock::now();
+            stats->last_dequeue = 0;
+        }
+    }
+    ~ProcessTimer() {
+        if (stats) {
+            stats->processing.record(TraceClock::now() - start);
+        }
+    }
+
+private:
+    ThreadStats* stats = nullptr;
+    uint64_t start = 0;
+};
+
+// --- A traced version of ConsumerProducer.cpp's queue ---
+
+template<class T>
+class TracedQueue {
+public:
+    void push(T value) {
+        // Stamp outside the lock: we want the time the producer handed the message over.
+        uint64_t stamp = tracer.enabled.load(std::memory_order_relaxed) ? TraceClock::now() : 0;
+        size_t depth;
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            items.push({std::move(value), stamp});
+            depth = items.size();
+        }
+        if (stamp) {
+            tracer.note_depth(depth);
+        }
+        cv.notify_one();
+    }
+
+    // Blocks until an item arrives; returns false once finished and empty.
+    bool pop(T& out) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this] { return !items.empty() || finished; });
+        if (items.empty()) {
+            return false;
+        }
+        Entry e = std::move(items.front());
+        items.pop();
+        lock.unlock();
+        if (e.stamp) {
+            uint64_t now = TraceClock::now();
+            ThreadStats& stats = tracer.local();
+            stats.residence.record(now - e.stamp);
+            stats.last_dequeue = now;
+        }
+        out = std::move(e.value);
+        return true;
+    }
+
+    void finish() {
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            finished = true;
+        }
+        cv.notify_all();
+    }
+
+private:
+    struct Entry {
+        T value;
+        uint64_t stamp; // 0 = not traced.
+    };
+    std::queue<Entry> items;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool finished = false;
+};
+
+// --- Exporter ---
+
+// Prints one line per interval with the percentiles of the messages seen during that interval.
+class Exporter {
+public:
+    explicit Exporter(std::chrono::milliseconds interval) : interval(interval), thread([this] { run(); }) {}
+
+    ~Exporter() {
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            stopping = true;
+        }
+        cv.notify_one();
+        thread.join();
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mtx);
+        bool last = false;
+        while (!last) {
+            last = cv.wait_for(lock, interval, [this] { return stopping; });
+            export_once();
+        }
+    }
+
+    void export_once() {
+        Snapshot residence, processing;
+        size_t high_water;
+        tracer.collect(residence, processing, high_water);
+        // Histograms only ever grow; this interval is the difference from the previous one.
+        Snapshot r = residence, p = processing;
+        for (int b = 0; b < LatencyHistogram::kBuckets; ++b) {
+            r.buckets[b] -= prev_residence.buckets[b];
+            p.buckets[b] -= prev_processing.buckets[b];
+        }
+        prev_residence = residence;
+        prev_processing = processing;
+        if (r.count() == 0 && p.count() == 0 && high_water == 0) {
+            return; // Idle interval.
+        }
+
+        char line[256];
+        std::snprintf(line, sizeof(line),
+                      "[trace] msgs %6llu | in queue p50 %8.1f us  p99 %8.1f us  p999 %8.1f us | "
+                      "processing p50 %6.1f us  p99 %6.1f us | depth high-water %zu",
+                      static_cast<unsigned long long>(r.count()), r.percentile(50) / 1000, r.percentile(99) / 1000,
+                      r.percentile(99.9) / 1000, p.percentile(50) / 1000, p.percentile(99) / 1000, high_water);
+        std::cout << line << std::endl;
+    }
+
+    std::chrono::milliseconds interval;
+    Snapshot prev_residence, prev_processing;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping = false;
+    std::thread thread; // Last, so everything it uses exists before it starts.
+};
+
+// --- Example: ConsumerProducer.cpp with bursts, traced ---
+
+void example() {
+    std::cout << "Example: 1 producer sending bursts, 2 consumers, exporting every 200 ms" << std::endl;
+    TracedQueue<std::string> data_queue;
+    Exporter exporter(std::chrono::milliseconds(200));
+
+    std::thread prod([&] {
+        for (int burst = 0; burst < 10; ++burst) {
+            // Bursts get bigger, so the consumers fall further behind each time.
+            for (int i = 0; i < 200 * (burst + 1); ++i) {
+                data_queue.push("Data packet " + std::to_string(i));
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        data_queue.finish();
+    });
+    auto consumer = [&] {
+        std::string data;
+        while (data_queue.pop(data)) {
+            ProcessTimer timer;
+            // Simulated work: about 20 us.
+            auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(20);
+            while (std::chrono::steady_clock::now() < until) {
+            }
+        }
+    };
+    std::thread cons(consumer);
+    std::thread cons2(consumer);
+    prod.join();
+    cons.join();
+    cons2.join();
+}
+
+// --- Benchmark: cost of tracing per message ---
+
+double ns_per_message(long long n, bool traced) {
+    tracer.enabled = traced;
+    TracedQueue<long long> q;
+    long long sink = 0, v = 0;
+    auto start = std::chrono::steady_clock::now();
+    // One thread, push then pop: no waiting, so the difference is the tracing work itself.
+    for (long long i = 0; i < n; ++i) {
+        q.push(i);
+        q.pop(v);
+        ProcessTimer timer;
+        sink += v;
+    }
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    volatile long long keep = sink;
+    (void)keep;
+    return ns / static_cast<double>(n);
+}
+
+// What one clock read costs here. Under a hypervisor rdtsc can cost several times what it
+// does on bare metal, so the overhead below is reported both with and without it.
+double ns_per_clock_read(long long n) {
+    uint64_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long long i = 0; i < n; ++i) {
+        sink += TraceClock::now();
+    }
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    volatile uint64_t keep = sink;
+    (void)keep;
+    return ns / static_cast<double>(n);
+}
+
+int main(int argc, char* argv[]) {
+    TraceClock::calibrate();
+#ifdef HAVE_TSC
+    std::cout << "TSC: " << 1.0 / TraceClock::ns_per_tick << " ticks/ns" << std::endl;
+#else
+    std::cout << "No TSC, stamping with steady_clock" << std::endl;
+#endif
+    example();
+
+    long long n = argc > 1 ? std::stoll(argv[1]) : 5000000;
+    double best_off = 1e9, best_on = 1e9;
+    for (int round = 0; round < 3; ++round) {
+        best_off = std::min(best_off, ns_per_message(n, false));
+        best_on = std::min(best_on, ns_per_message(n, true));
+    }
+    std::cout << "Benchmark: push + pop + process timer, " << n << " messages, best of 3" << std::endl;
+    std::cout << "  tracing off: " << best_off << " ns/msg" << std::endl;
+    std::cout << "  tracing on:  " << best_on << " ns/msg" << std::endl;
+    double clock = ns_per_clock_read(n);
+    std::cout << "  overhead:    " << best_on - best_off << " ns/msg: 3 clock reads at " << clock << " ns each, plus "
+              << best_on - best_off - 3 * clock << " ns for 2 histogram records and the depth check" << std::endl;
+    return 0;
+}
@@ -0,0 +1,376 @@
+// An unbounded lock-free multi-producer/multi-consumer queue (Michael & Scott, 1996),
+// with hazard pointers so that dequeued nodes are freed safely.
+// ConsumerProducer.cpp and ThreadPool::tasks both protect a std::queue with one mutex: with many
+// producers and consumers, everybody queues up on that lock. The Michael-Scott queue is a linked
+// list with a dummy head node, where enqueue and dequeue each need a compare-and-swap or two:
+//   - push: CAS the new node onto tail->next, then (try to) swing `tail` forward.
+//   - pop:  CAS `head` from the dummy to its successor. The successor becomes the new dummy,
+//           and we take its value.
+//   - If a thread sees `tail` lagging behind (tail->next != nullptr), it helps swing it forward
+//     instead of waiting. That is what makes the queue lock-free: a stalled thread never blocks
+//     the others.
+// The hard part is freeing nodes. After a pop we can't `delete` the old dummy right away, because
+// another thread may have just loaded `head` and be about to read head->next. Hazard pointers solve
+// that. Before dereferencing a node, a thread publishes its address in a per-thread slot. Retired
+// nodes are kept on a per-thread list, and only freed once a scan shows no hazard slot points at them.
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <queue>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+#include <unistd.h>
+
+// --- Hazard pointers ---
+
+const int kMaxThreads = 128;
+const int kHazardsPerThread = 2;
+const size_t kScanThreshold = 2 * kMaxThreads * kHazardsPerThread;
+
+// One record per thread, each on its own cache line. A thread claims a free record on first use.
+struct alignas(64) HazardRecord {
+    std::atomic<bool> in_use{false};
+    std::atomic<void*> hazards[kHazardsPerThread] = {};
+};
+
+HazardRecord hazard_records[kMaxThreads];
+
+// A retired node and how to delete it: the domain is shared by queues of any element type.
+struct Retired {
+    void* ptr;
+    void (*deleter)(void*);
+};
+
+std::mutex orphan_mtx;
+std::vector<Retired> orphans; // Retired nodes left behind by threads that exited.
+
+// Frees every node in `list` that no hazard pointer protects; keeps the rest.
+void scan(std::vector<Retired>& list) {
+    std::vector<void*> protected_ptrs;
+    for (HazardRecord& rec : hazard_records) {
+        for (auto& h : rec.hazards) {
+            if (void* p = h.load()) {
+                protected_ptrs.push_back(p);
+            }
+        }
+    }
+    std::sort(protected_ptrs.begin(), protected_ptrs.end());
+
+    std::vector<Retired> still_protected;
+    for (const Retired& r : list) {
+        if (std::binary_search(protected_ptrs.begin(), protected_ptrs.end(), r.ptr)) {
+            still_protected.push_back(r);
+        } else {
+            r.deleter(r.ptr);
+        }
+    }
+    list.swap(still_protected);
+}
+
+// This thread's hazard record and retire list. Released when the thread exits.
+class ThreadHazards {
+public:
+    ThreadHazards() {
+        for (HazardRecord& rec : hazard_records) {
+            bool expected = false;
+            if (rec.in_use.compare_exchange_strong(expected, true)) {
+                record = &rec;
+                return;
+            }
+        }
+        std::terminate(); // More than kMaxThreads threads at once.
+    }
+
+    ~ThreadHazards() {
+        for (auto& h : record->hazards) {
+            h.store(nullptr);
+        }
+        scan(retired);
+        if (!retired.empty()) {
+            std::lock_guard<std::mutex> guard(orphan_mtx);
+            orphans.insert(orphans.end(), retired.begin(), retired.end());
+        }
+        record->in_use.store(false);
+    }
+
+    // Publishes src's current value in slot i. The re-check makes sure the pointer was still
+    // reachable *after* it became visible as a hazard, so a concurrent scan can't have missed it.
+    // (Default seq_cst ordering: the hazard store must not be reordered after the re-load.)
+    template<class Node>
+    Node* protect(int i, const std::atomic<Node*>& src) {
+        Node* p = src.load();
+        while (true) {
+            record->hazards[i].store(p);
+            Node* again = src.load();
+            if (again == p) {
+                return p;
+            }
+            p = again;
+        }
+    }
+
+    void set(int i, void* p) { record->hazards[i].store(p); }
+    void clear(int i) { record->hazards[i].store(nullptr); }
+
+    template<class Node>
+    void retire(Node* node) {
+        retired.push_back({node, [](void* p) { delete static_cast<Node*>(p); }});
+        // Scanning costs O(#threads * #hazards), so only do it once that many nodes have piled up:
+        // then at least half of the list can be freed, and the cost per node stays constant.
+        if (retired.size() >= kScanThreshold) {
+            scan(retired);
+        }
+    }
+
+private:
+    HazardRecord* record = nullptr;
+    std::vector<Retired> retired;
+};
+
+ThreadHazards& thread_hazards() {
+    thread_local ThreadHazards hazards;
+    return hazards;
+}
+
+// Frees what exited threads left behind. Call when no thread is using the queues.
+void collect_orphans() {
+    std::lock_guard<std::mutex> guard(orphan_mtx);
+    scan(orphans);
+}
+
+// --- The Michael-Scott queue ---
+
+// Nodes allocated and not yet freed, for the memory report. Counted per thread, so the count
+// doesn't add a contended cache line to every push and pop that LockedQueue wouldn't pay. Threads
+// take slots in turn; a node is often freed by another thread than the one that allocated it,
+// so only the sum means anything.
+struct alignas(64) NodeCount {
+    std::atomic<long long> n{0};
+};
+
+NodeCount node_counts[kMaxThreads];
+
+void count_nodes(long long delta) {
+    static std::atomic<int> next_slot{0};
+    thread_local int slot = next_slot.fetch_add(1, std::memory_order_relaxed) % kMaxThreads;
+    node_counts[slot].n.fetch_add(delta, std::memory_order_relaxed);
+}
+
+long long live_nodes() {
+    long long sum = 0;
+    for (const NodeCount& c : node_counts) {
+        sum += c.n.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+template<class T>
+class LockFreeQueue {
+public:
+    static constexpr bool counts_nodes = true;
+
+    LockFreeQueue() {
+        Node* dummy = new Node();
+        head.store(dummy);
+        tail.store(dummy);
+    }
+
+    ~LockFreeQueue() {
+        // No other thread may be using the queue any more, so plain deletes are fine.
+        Node* n = head.load();
+        while (n) {
+            Node* next = n->next.load();
+            delete n;
+            n = next;
+        }
+    }
+
+    void push(T value) {
+        Node* node = new Node(std::move(value));
+        ThreadHazards& hp = thread_hazards();
+        while (true) {
+            Node* t = hp.protect(0, tail);
+            Node* next = t->next.load();
+            if (t != tail.load()) {
+                continue; // Tail moved under us; start over.
+            }
+            if (next == nullptr) {
+                if (t->next.compare_exchange_weak(next, node)) {
+                    // Linked in. Swinging tail may fail if someone helped us already; that's fine.
+                    tail.compare_exchange_strong(t, node);
+                    break;
+                }
+            } else {
+                // Tail is lagging: help the other producer finish, then retry.
+                tail.compare_exchange_weak(t, next);
+            }
+        }
+        hp.clear(0);
+    }
+
+    bool try_pop(T& out) {
+        ThreadHazards& hp = thread_hazards();
+        while (true) {
+            Node* h = hp.protect(0, head);
+            Node* t = tail.load();
+            Node* next = h->next.load();
+            hp.set(1, next);
+            // If head is still h, then next was still reachable when we published the hazard.
+            if (h != head.load()) {
+                continue;
+            }
+            if (next == nullptr) {
+                hp.clear(0);
+                hp.clear(1);
+                return false; // Empty.
+            }
+            if (h == t) {
+                tail.compare_exchange_weak(t, next); // Tail is lagging: help it along.
+                continue;
+            }
+            if (head.compare_exchange_weak(h, next)) {
+                // `next` is the new dummy. Only the thread that won the CAS touches its value,
+                // and hazard slot 1 keeps it alive while we do.
+                out = std::move(next->value);
+                hp.clear(0);
+                hp.clear(1);
+                hp.retire(h);
+                return true;
+            }
+        }
+    }
+
+private:
+    struct Node {
+        Node() { count_nodes(1); }
+        explicit Node(T v) : value(std::move(v)) { count_nodes(1); }
+        ~Node() { count_nodes(-1); }
+
+        std::atomic<Node*> next{nullptr};
+        T value{};
+    };
+
+    // Producers hammer tail, consumers hammer head: keep them on separate cache lines.
+    alignas(64) std::atomic<Node*> head;
+    alignas(64) std::atomic<Node*> tail;
+};
+
+// The baseline: std::queue behind a mutex, as in ConsumerProducer.cpp and ThreadPool::tasks.
+template<class T>
+class LockedQueue {
+public:
+    static constexpr bool counts_nodes = false; // std::queue's chunks aren't tracked; see RSS.
+
+    void push(T value) {
+        std::lock_guard<std::mutex> guard(mtx);
+        q.push(std::move(value));
+    }
+
+    bool try_pop(T& out) {
+        std::lock_guard<std::mutex> guard(mtx);
+        if (q.empty()) {
+            return false;
+        }
+        out = std::move(q.front());
+        q.pop();
+        return true;
+    }
+
+private:
+    std::queue<T> q;
+    std::mutex mtx;
+};
+
+// --- Stress benchmark ---
+
+long long rss_kib() {
+    std::ifstream statm("/proc/self/statm");
+    long long size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+template<class Queue>
+void stress(const char* name, int producers, int consumers, long long items_per_producer) {
+    Queue q;
+    std::atomic<long long> consumed{0};
+    std::atomic<long long> checksum{0};
+    std::atomic<bool> done{false};
+    long long total = producers * items_per_producer;
+    std::vector<long long> node_samples;
+    long long peak_rss = 0;
+
+    // Samples memory while the stress runs: nodes allocated but not yet freed, and process RSS.
+    std::thread monitor([&] {
+        while (!done.load()) {
+            node_samples.push_back(live_nodes());
+            peak_rss = std::max(peak_rss, rss_kib());
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&q, items_per_producer] {
+            for (long long i = 0; i < items_per_producer; ++i) {
+                q.push(i);
+            }
+        });
+    }
+    for (int c = 0; c < consumers; ++c) {
+        threads.emplace_back([&] {
+            long long value;
+            long long local_sum = 0;
+            while (consumed.load(std::memory_order_relaxed) < total) {
+                if (q.try_pop(value)) {
+                    local_sum += value;
+                    consumed.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+            checksum += local_sum;
+        });
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    done = true;
+    monitor.join();
+    collect_orphans();
+
+    bool ok = checksum == producers * (items_per_producer * (items_per_producer - 1) / 2);
+    long long peak_nodes = node_samples.empty()
+        ? 0 : *std::max_element(node_samples.begin(), node_samples.end());
+    std::cout << name << " " << producers << "P/" << consumers << "C: "
+              << static_cast<long long>(2 * total / seconds) << " ops/s, peak RSS " << peak_rss << " KiB";
+    if (!Queue::counts_nodes) {
+        std::cout << (ok ? "" : "  (CHECKSUM ERROR)") << std::endl;
+        return;
+    }
+    std::cout << ", peak live nodes " << peak_nodes << (ok ? "" : "  (CHECKSUM ERROR)") << std::endl;
+    std::cout << "    live nodes over time:";
+    size_t step = std::max<size_t>(1, node_samples.size() / 8);
+    for (size_t i = 0; i < node_samples.size(); i += step) {
+        std::cout << " " << node_samples[i];
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    long long n = argc > 1 ? std::stoll(argv[1]) : 200000;
+
+    for (int producers : {1, 2, 4}) {
+        for (int consumers : {1, 2, 4}) {
+            stress<LockedQueue<long long>>("mutex + std::queue    ", producers, consumers, n);
+            stress<LockFreeQueue<long long>>("Michael-Scott + hazards", producers, consumers, n);
+        }
+    }
+    std::cout << "Live nodes after all queues are gone: " << live_nodes() << std::endl;
+    return 0;
+}
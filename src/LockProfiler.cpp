@@ -0,0 +1,447 @@
+// A lock contention profiler: an instrumented mutex that shows which locks hurt, and where.
+// Replace `std::mutex mtx` (Mutex.cpp, LockGuard.cpp) or ThreadPool's queue_mutex with `Mutex`,
+// and `std::lock_guard<std::mutex>` with `LockGuard<Mutex>`. With LOCK_PROFILING=1 (the default
+// here), every lock records:
+//   - acquisitions, and how many were contended (try_lock failed, so we had to wait),
+//   - wait time (of the contended acquisitions) and hold time, as totals and log2 histograms,
+//   - the same per call site: the file:line that called lock() or built the LockGuard.
+// report() ranks the locks by total wait time, with the worst call sites under each.
+// Compile with -DLOCK_PROFILING=0 and Mutex *is* std::mutex and LockGuard *is* std::lock_guard:
+// aliases, not wrappers, so there's nothing left to cost anything.
+// Call sites come from __builtin_FILE()/__builtin_LINE() default arguments (GCC and Clang; C++20
+// has std::source_location for this). Locks taken inside library code, like the re-lock at the
+// end of condition_variable_any::wait(), are reported with the library's file:line.
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <algorithm>
+#include <type_traits>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+
+#ifndef LOCK_PROFILING
+#define LOCK_PROFILING 1
+#endif
+
+#if LOCK_PROFILING
+
+inline long long profiler_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Bucket b counts durations in [2^b, 2^(b+1)) ns.
+struct Log2Histogram {
+    static constexpr int kBuckets = 48;
+    std::atomic<long long> buckets[kBuckets] = {};
+    std::atomic<long long> total_ns{0};
+
+    void record(long long ns) {
+        int b = ns <= 1 ? 0 : std::min(kBuckets - 1, 63 - __builtin_clzll(static_cast<unsigned long long>(ns)));
+        buckets[b].fetch_add(1, std::memory_order_relaxed);
+        total_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+};
+
+// Statistics for one call site of one lock. Only call sites record anything; a lock's totals are
+// the sum of its sites, added up when the report is made. That halves the atomic updates per
+// acquisition.
+struct SiteStats {
+    std::string where;
+    std::atomic<long long> acquisitions{0};
+    std::atomic<long long> contended{0};
+    Log2Histogram wait, hold; // wait only holds contended acquisitions; the others waited 0 ns.
+
+    void record_acquire(bool was_contended, long long wait_ns) {
+        acquisitions.fetch_add(1, std::memory_order_relaxed);
+        if (was_contended) {
+            contended.fetch_add(1, std::memory_order_relaxed);
+            wait.record(wait_ns);
+        }
+    }
+};
+
+// Plain totals, for the report.
+struct Summary {
+    std::string where;
+    long long acquisitions = 0, contended = 0, wait_ns = 0;
+    long long wait_buckets[Log2Histogram::kBuckets] = {};
+    long long hold_buckets[Log2Histogram::kBuckets] = {};
+
+    void add(const SiteStats& s) {
+        acquisitions += s.acquisitions.load(std::memory_order_relaxed);
+        contended += s.contended.load(std::memory_order_relaxed);
+        wait_ns += s.wait.total_ns.load(std::memory_order_relaxed);
+        for (int b = 0; b < Log2Histogram::kBuckets; ++b) {
+            wait_buckets[b] += s.wait.buckets[b].load(std::memory_order_relaxed);
+            hold_buckets[b] += s.hold.buckets[b].load(std::memory_order_relaxed);
+        }
+    }
+
+    // Upper bound of the bucket holding the p-th percentile.
+    static long long percentile(const long long (&buckets)[Log2Histogram::kBuckets], double p) {
+        long long n = 0;
+        for (long long c : buckets) {
+            n += c;
+        }
+        long long rank = static_cast<long long>(p / 100.0 * static_cast<double>(n));
+        long long seen = 0;
+        for (int b = 0; b < Log2Histogram::kBuckets; ++b) {
+            seen += buckets[b];
+            if (seen > rank) {
+                return 2LL << b;
+            }
+        }
+        return 0;
+    }
+};
+
+struct LockInfo;
+
+// Owns every lock's and call site's statistics, so they outlive the locks for the report.
+class LockRegistry {
+public:
+    static LockRegistry& instance() {
+        static LockRegistry r;
+        return r;
+    }
+
+    LockInfo* new_lock(std::string where);
+
+    // The statistics for `lock` at file:line. Each thread caches what it has looked up, so the
+    // registry's mutex is only taken the first time a thread uses a call site.
+    SiteStats* site(LockInfo* lock, const char* file, int line) {
+        struct Key {
+            LockInfo* lock;
+            const char* file;
+            int line;
+            bool operator==(const Key& o) const { return lock == o.lock && file == o.file && line == o.line; }
+        };
+        struct KeyHash {
+            size_t operator()(const Key& k) const {
+                return std::hash<const void*>()(k.lock) ^ (std::hash<const void*>()(k.file) * 31) ^
+                       static_cast<size_t>(k.line) * 1000003;
+            }
+        };
+        thread_local std::unordered_map<Key, SiteStats*, KeyHash> cache;
+        thread_local Key last_key{nullptr, nullptr, 0};
+        thread_local SiteStats* last = nullptr;
+        Key key{lock, file, line};
+        if (key == last_key) {
+            return last; // Loops lock the same lock at the same site over and over.
+        }
+        auto it = cache.find(key);
+        if (it == cache.end()) {
+            it = cache.emplace(key, shared_site(lock, file, line)).first;
+        }
+        last_key = key;
+        last = it->second;
+        return last;
+    }
+
+    void report(std::ostream& out, size_t max_sites = 3);
+
+private:
+    SiteStats* shared_site(LockInfo* lock, const char* file, int line);
+    static void print_line(std::ostream& out, const char* indent, const Summary& s);
+
+    std::mutex mtx;
+    std::vector<std::unique_ptr<LockInfo>> locks;
+};
+
+struct LockInfo {
+    std::string where;
+    std::unordered_map<std::string, std::unique_ptr<SiteStats>> sites; // Guarded by the registry's mutex.
+};
+
+LockInfo* LockRegistry::new_lock(std::string where) {
+    std::lock_guard<std::mutex> guard(mtx);
+    locks.push_back(std::make_unique<LockInfo>());
+    locks.back()->where = std::move(where);
+    return locks.back().get();
+}
+
+SiteStats* LockRegistry::shared_site(LockInfo* lock, const char* file, int line) {
+    std::lock_guard<std::mutex> guard(mtx);
+    std::string where = std::string(file) + ":" + std::to_string(line);
+    auto& s = lock->sites[where];
+    if (!s) {
+        s = std::make_unique<SiteStats>();
+        s->where = where;
+    }
+    return s.get();
+}
+
+void LockRegistry::report(std::ostream& out, size_t max_sites) {
+    std::lock_guard<std::mutex> guard(mtx);
+    struct Entry {
+        Summary total;
+        std::vector<Summary> sites;
+    };
+    std::vector<Entry> entries;
+    for (auto& l : locks) {
+        Entry e;
+        e.total.where = l->where;
+        for (auto& s : l->sites) {
+            e.total.add(*s.second);
+            e.sites.emplace_back();
+            e.sites.back().where = s.second->where;
+            e.sites.back().add(*s.second);
+        }
+        if (e.total.acquisitions > 0) {
+            entries.push_back(std::move(e));
+        }
+    }
+    auto by_wait = [](const Summary& a, const Summary& b) { return a.wait_ns > b.wait_ns; };
+    std::sort(entries.begin(), entries.end(), [&](const Entry& a, const Entry& b) { return by_wait(a.total, b.total); });
+
+    out << "Lock contention report, ranked by total wait time" << std::endl;
+    for (Entry& e : entries) {
+        print_line(out, "", e.total);
+        std::sort(e.sites.begin(), e.sites.end(), by_wait);
+        for (size_t i = 0; i < e.sites.size() && i < max_sites; ++i) {
+            print_line(out, "    at ", e.sites[i]);
+        }
+    }
+}
+
+void LockRegistry::print_line(std::ostream& out, const char* indent, const Summary& s) {
+    char line[256];
+    std::snprintf(line, sizeof(line),
+                  "%s%-40s acq %9lld  contended %5.1f%%  wait total %9.3f ms  contended wait p50 %9lld ns  "
+                  "p99 %10lld ns  hold p99 %9lld ns",
+                  indent, s.where.c_str(), s.acquisitions,
+                  s.acquisitions ? 100.0 * static_cast<double>(s.contended) / static_cast<double>(s.acquisitions) : 0.0,
+                  static_cast<double>(s.wait_ns) / 1e6, Summary::percentile(s.wait_buckets, 50),
+                  Summary::percentile(s.wait_buckets, 99), Summary::percentile(s.hold_buckets, 99));
+    out << line << std::endl;
+}
+
+class ProfiledMutex {
+public:
+    // Named after where it's declared, unless given a name.
+    explicit ProfiledMutex(const char* name = nullptr, const char* file = __builtin_FILE(), int line = __builtin_LINE())
+        : info(LockRegistry::instance().new_lock(name ? name : std::string(file) + ":" + std::to_string(line))) {}
+
+    ProfiledMutex(const ProfiledMutex&) = delete;
+    ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+    void lock(const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+        SiteStats* site = LockRegistry::instance().site(info, file, line);
+        bool contended = !m.try_lock();
+        long long waited = 0;
+        long long now;
+        if (contended) {
+            long long start = profiler_now_ns();
+            m.lock();
+            now = profiler_now_ns();
+            waited = now - start;
+        } else {
+            now = profiler_now_ns();
+        }
+        site->record_acquire(contended, waited);
+        // Only the holder writes these.
+        held_since = now;
+        held_site = site;
+    }
+
+    bool try_lock(const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+        if (!m.try_lock()) {
+            return false;
+        }
+        SiteStats* site = LockRegistry::instance().site(info, file, line);
+        site->record_acquire(false, 0);
+        held_since = profiler_now_ns();
+        held_site = site;
+        return true;
+    }
+
+    void unlock() {
+        long long held = profiler_now_ns() - held_since;
+        SiteStats* site = held_site;
+        m.unlock();
+        site->hold.record(held);
+    }
+
+private:
+    std::mutex m;
+    LockInfo* info;
+    long long held_since = 0;
+    SiteStats* held_site = nullptr;
+};
+
+// std::lock_guard calls lock() from inside <mutex>; this one passes the caller's site through.
+template<class M>
+class ProfiledLockGuard {
+public:
+    explicit ProfiledLockGuard(M& m, const char* file = __builtin_FILE(), int line = __builtin_LINE()) : m(m) {
+        m.lock(file, line);
+    }
+    ~ProfiledLockGuard() { m.unlock(); }
+    ProfiledLockGuard(const ProfiledLockGuard&) = delete;
+    ProfiledLockGuard& operator=(const ProfiledLockGuard&) = delete;
+
+private:
+    M& m;
+};
+
+using Mutex = ProfiledMutex;
+template<class M> using LockGuard = ProfiledLockGuard<M>;
+inline void lock_report(std::ostream& out) { LockRegistry::instance().report(out); }
+
+#else
+
+using Mutex = std::mutex;
+template<class M> using LockGuard = std::lock_guard<M>;
+inline void lock_report(std::ostream& out) { out << "Lock profiling compiled out (LOCK_PROFILING=0)" << std::endl; }
+
+static_assert(std::is_same<Mutex, std::mutex>::value, "compiled out means plain std::mutex");
+
+#endif
+
+// --- ThreadPool.cpp's pool, with queue_mutex as a Mutex ---
+
+class ThreadPool {
+public:
+    ThreadPool(size_t num_threads) : stop(false) {
+        for (size_t i = 0; i < num_threads; ++i) {
+            workers.emplace_back([this] {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<Mutex> lock(this->queue_mutex);
+                        this->condition.wait(lock, [this] { return this->stop || !this->tasks.empty(); });
+                        if (this->stop && this->tasks.empty()) {
+                            return;
+                        }
+                        task = std::move(this->tasks.front());
+                        this->tasks.pop();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    template<class F, class... Args>
+    auto submit(F&& f, Args&&... args) -> std::future<decltype(f(args...))> {
+        using return_type = decltype(f(args...));
+        auto task = std::make_shared<std::packaged_task<return_type()>>(
+            std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+        std::future<return_type> res = task->get_future();
+        {
+            LockGuard<Mutex> lock(queue_mutex);
+            if (stop) {
+                throw std::runtime_error("submit on stopped ThreadPool");
+            }
+            tasks.emplace([task]() { (*task)(); });
+        }
+        condition.notify_one();
+        return res;
+    }
+
+    ~ThreadPool() {
+        {
+            LockGuard<Mutex> lock(queue_mutex);
+            stop = true;
+        }
+        condition.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+
+    Mutex queue_mutex;
+    std::conditional_t<std::is_same<Mutex, std::mutex>::value, std::condition_variable, std::condition_variable_any>
+        condition;
+    bool stop;
+};
+
+// --- Example: Mutex.cpp, LockGuard.cpp and ThreadPool together ---
+
+long long counter = 0;
+Mutex mtx;           // The counter lock from Mutex.cpp / LockGuard.cpp.
+Mutex slow_mtx;      // A lock held for a long time.
+
+void increment_mutex() { // Mutex.cpp
+    for (int i = 0; i < 100000; ++i) {
+        mtx.lock();
+        long long temp = counter;
+        temp++;
+        counter = temp;
+        mtx.unlock();
+    }
+}
+
+void increment_lock_guard() { // LockGuard.cpp
+    for (int i = 0; i < 100000; ++i) {
+        LockGuard<Mutex> guard(mtx);
+        counter++;
+    }
+}
+
+void slow_section() {
+    for (int i = 0; i < 50; ++i) {
+        LockGuard<Mutex> guard(slow_mtx);
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+// --- Benchmark: the cost of one uncontended lock/unlock ---
+
+template<class M, class Guard>
+double ns_per_lock(long long n) {
+    M m;
+    long long x = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long long i = 0; i < n; ++i) {
+        Guard g(m);
+        ++x;
+    }
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    volatile long long keep = x;
+    (void)keep;
+    return ns / static_cast<double>(n);
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "LOCK_PROFILING=" << LOCK_PROFILING << std::endl;
+    std::thread t1(increment_mutex), t2(increment_lock_guard), t3(increment_lock_guard);
+    std::thread s1(slow_section), s2(slow_section), s3(slow_section);
+    {
+        ThreadPool pool(4);
+        std::vector<std::future<int>> results;
+        for (int i = 0; i < 20000; ++i) {
+            results.push_back(pool.submit([](int x) { return x * 2; }, i));
+        }
+        for (auto& r : results) {
+            r.get();
+        }
+    }
+    for (std::thread* t : {&t1, &t2, &t3, &s1, &s2, &s3}) {
+        t->join();
+    }
+    std::cout << "Final counter value: " << counter << std::endl;
+    lock_report(std::cout);
+
+    long long n = argc > 1 ? std::stoll(argv[1]) : 5000000;
+    std::cout << "Uncontended lock + unlock: std::mutex "
+              << ns_per_lock<std::mutex, std::lock_guard<std::mutex>>(n) << " ns, Mutex "
+              << ns_per_lock<Mutex, LockGuard<Mutex>>(n) << " ns" << std::endl;
+    return 0;
+}
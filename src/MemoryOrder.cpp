@@ -0,0 +1,211 @@
+// Memory orders, measured: Atomic.cpp's counter with relaxed, acq_rel and seq_cst increments,
+// flag publication with release/acquire, and what each ordering actually costs on x86.
+// Atomic.cpp says to stick to seq_cst unless you can prove a weaker ordering correct. Here are
+// the proofs for the common cases, and the numbers that tell you whether it's worth the bother.
+//   - increment_relaxed(): fetch_add(1, relaxed). Every read-modify-write of one atomic works
+//     on the latest value in that atomic's modification order, whatever the memory order, so
+//     no increment is ever lost. The ordering only says what *other* memory the increment
+//     synchronizes, and the counter guards no other memory. The final value is read after
+//     join(), and join() synchronizes with everything the thread did. So relaxed is correct
+//     for counters, statistics and ID generators.
+//   - increment_acq_rel(): also correct, and orders nothing useful here. You need acq_rel when
+//     the RMW also hands over other data, as in a reference count whose last decrement frees the
+//     object.
+//   - increment_seq_cst(): Atomic.cpp's atomic_counter++. Also correct. On top of acq_rel it puts
+//     every seq_cst operation in one global order, which only matters for patterns like the
+//     store-buffer example below.
+// On x86 all three compile to the same `lock xadd`: an x86 RMW is a full barrier whatever you ask
+// for, so relaxing a counter gains nothing there. It can on ARM or POWER, where relaxed drops the
+// barriers. What does cost on x86 is a seq_cst *store*: it's an `xchg` (a full barrier that drains
+// the store buffer), while release and relaxed stores are a plain `mov`.
+// Publishing non-atomic data through a flag (the flag example Atomic.cpp's comment refers to):
+//   writer: payload = ...;  ready.store(true, release);
+//   reader: while (!ready.load(acquire)) {}  use(payload);
+// The acquire load that sees the release store synchronizes with it, so everything written
+// before the store is visible after the load. With relaxed on both sides nothing orders payload
+// against ready: the reader can see ready == true and old payload. With a plain non-atomic
+// payload that's a data race, undefined behavior. The demo below therefore makes the payload
+// relaxed atomics, which can legally be stale, and counts how often they are. x86 keeps stores
+// in order and loads in order, so it will usually count 0 even for relaxed. ARM and POWER don't,
+// and the compiler may reorder relaxed accesses on any machine.
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+std::atomic<long long> atomic_counter = {0};
+
+void increment_relaxed(long long n) {
+    for (long long i = 0; i < n; ++i) {
+        atomic_counter.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void increment_acq_rel(long long n) {
+    for (long long i = 0; i < n; ++i) {
+        atomic_counter.fetch_add(1, std::memory_order_acq_rel);
+    }
+}
+
+void increment_seq_cst(long long n) {
+    for (long long i = 0; i < n; ++i) {
+        atomic_counter++;
+    }
+}
+
+// --- Flag publication ---
+
+struct Payload {
+    std::atomic<long long> a{0}, b{0}; // Relaxed atomics, so a stale read is defined behavior.
+};
+
+// The writer publishes rounds 1..rounds, one at a time: it fills in the payload, raises the flag,
+// and waits for the reader to lower it. Returns how often the reader saw the flag but not the
+// matching payload.
+long long publish(long long rounds, std::memory_order store_order, std::memory_order load_order) {
+    Payload payload;
+    std::atomic<long long> ready{0}; // The round published, or 0.
+    long long stale = 0;
+
+    std::thread reader([&] {
+        for (long long r = 1; r <= rounds; ++r) {
+            long long seen;
+            while ((seen = ready.load(load_order)) == 0) {
+                std::this_thread::yield();
+            }
+            if (payload.a.load(std::memory_order_relaxed) != seen || payload.b.load(std::memory_order_relaxed) != seen) {
+                ++stale;
+            }
+            ready.store(0, std::memory_order_release);
+        }
+    });
+    for (long long r = 1; r <= rounds; ++r) {
+        payload.a.store(r, std::memory_order_relaxed);
+        payload.b.store(r, std::memory_order_relaxed);
+        ready.store(r, store_order);
+        while (ready.load(std::memory_order_acquire) != 0) {
+            std::this_thread::yield();
+        }
+    }
+    reader.join();
+    return stale;
+}
+
+// --- Store buffering: the one pattern that needs seq_cst ---
+
+// T1: x = 1; r1 = y.   T2: y = 1; r2 = x.
+// Under seq_cst the four operations have one global order, so whichever store is first, the other
+// thread's load sees it, and r1 == r2 == 0 is impossible. Under release/acquire it's allowed, and
+// x86 really does it: each store waits in its core's store buffer while the following load goes
+// ahead. This is the reordering x86's seq_cst store (xchg) pays to prevent.
+// The window is a few nanoseconds, so like a litmus-test harness both threads leave a spin
+// barrier together every round: yielding there would wake them microseconds apart, and one
+// thread's store would be long visible before the other even started. Only on a single CPU,
+// where the two can't overlap anyway, does the barrier yield, to hand the CPU over.
+long long store_buffering(long long rounds, std::memory_order store_order, std::memory_order load_order) {
+    std::atomic<int> x{0}, y{0};
+    std::atomic<long long> arrived{0}, finished{0}; // Two per round: one from each thread.
+    int r1 = 0, r2 = 0;
+    long long both_zero = 0;
+    const bool yield = std::thread::hardware_concurrency() < 2;
+    auto barrier = [yield](std::atomic<long long>& count, long long target) {
+        count.fetch_add(1, std::memory_order_acq_rel);
+        while (count.load(std::memory_order_acquire) < target) {
+            if (yield) {
+                std::this_thread::yield();
+            }
+        }
+    };
+
+    std::thread t2([&] {
+        for (long long r = 1; r <= rounds; ++r) {
+            barrier(arrived, 2 * r);
+            y.store(1, store_order);
+            r2 = x.load(load_order);
+            barrier(finished, 2 * r);
+        }
+    });
+    for (long long r = 1; r <= rounds; ++r) {
+        x.store(0, std::memory_order_relaxed);
+        y.store(0, std::memory_order_relaxed);
+        barrier(arrived, 2 * r);
+        x.store(1, store_order);
+        r1 = y.load(load_order);
+        barrier(finished, 2 * r);
+        both_zero += r1 == 0 && r2 == 0;
+    }
+    t2.join();
+    return both_zero;
+}
+
+// --- Benchmark ---
+
+template<class F>
+double ns_per_op(int threads, long long per_thread, F f) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back(f, per_thread);
+    }
+    for (std::thread& w : workers) {
+        w.join();
+    }
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    return ns / static_cast<double>(threads * per_thread);
+}
+
+std::atomic<long long> published = {0};
+
+template<std::memory_order Order>
+void store_loop(long long n) {
+    for (long long i = 0; i < n; ++i) {
+        published.store(i, Order);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    long long per_thread = argc > 1 ? std::stoll(argv[1]) : 20000000;
+    long long rounds = argc > 2 ? std::stoll(argv[2]) : 20000;
+
+    std::cout << "Benchmark: " << per_thread << " ops per thread, " << std::thread::hardware_concurrency()
+              << " hardware threads" << std::endl;
+    std::cout << "threads | fetch_add ns/op: relaxed  acq_rel  seq_cst | final counts" << std::endl;
+    for (int threads : {1, 2, 4}) {
+        long long expected = threads * per_thread;
+        atomic_counter = 0;
+        double relaxed = ns_per_op(threads, per_thread, increment_relaxed);
+        long long c1 = atomic_counter.exchange(0);
+        double acq_rel = ns_per_op(threads, per_thread, increment_acq_rel);
+        long long c2 = atomic_counter.exchange(0);
+        double seq_cst = ns_per_op(threads, per_thread, increment_seq_cst);
+        long long c3 = atomic_counter.exchange(0);
+        char line[160];
+        std::snprintf(line, sizeof(line), "%7d | %24.2f %8.2f %8.2f | %s", threads, relaxed, acq_rel, seq_cst,
+                      c1 == expected && c2 == expected && c3 == expected ? "all exact" : "LOST INCREMENTS");
+        std::cout << line << std::endl;
+    }
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "1 thread  | store ns/op:   relaxed %5.2f  release %5.2f  seq_cst %5.2f",
+                  ns_per_op(1, per_thread, store_loop<std::memory_order_relaxed>),
+                  ns_per_op(1, per_thread, store_loop<std::memory_order_release>),
+                  ns_per_op(1, per_thread, store_loop<std::memory_order_seq_cst>));
+    std::cout << line << std::endl;
+
+    std::cout << "Flag publication, " << rounds << " rounds, reads of a stale payload:" << std::endl;
+    std::cout << "  release/acquire: " << publish(rounds, std::memory_order_release, std::memory_order_acquire)
+              << " (never, guaranteed)" << std::endl;
+    std::cout << "  relaxed:         " << publish(rounds, std::memory_order_relaxed, std::memory_order_relaxed)
+              << " (allowed; usually 0 on x86)" << std::endl;
+
+    std::cout << "Store buffering, " << rounds << " rounds, r1 == r2 == 0 seen:" << std::endl;
+    std::cout << "  seq_cst:         " << store_buffering(rounds, std::memory_order_seq_cst, std::memory_order_seq_cst)
+              << " (never, guaranteed)" << std::endl;
+    std::cout << "  release/acquire: " << store_buffering(rounds, std::memory_order_release, std::memory_order_acquire)
+              << " (allowed, and happens on multi-core x86)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,313 @@
+// Key-partitioned consumer groups: parallel consumers that still keep per-key ordering.
+// In ConsumerProducer.cpp two consumer() threads pop from one shared queue. Two messages with
+// the same key can be popped by different consumers and processed in either order.
+// Here (as in Kafka consumer groups):
+//   - Every key hashes onto one of a fixed number of partitions.
+//   - Every partition is owned by exactly one lane, and every lane has one consumer thread with
+//     its own FIFO queue. All messages of a key go through the same FIFO to the same thread, so
+//     they are processed in order, while different keys spread across all consumers.
+//   - A skewed key distribution can leave one lane much busier than the others. The dispatcher
+//     can then move partitions between lanes. Moving a partition must not let its new owner run
+//     ahead of messages still queued at the old one, so it's done with a small handshake:
+//       1. Hold{p}    is queued on the new lane: it starts stashing p's messages instead of running them.
+//       2. The partition is remapped, so new messages for p go to the new lane.
+//       3. Marker{p}  is queued on the old lane behind p's last old message.
+//       4. When the old lane reaches the marker, it sends Release{p} to the new lane, which then
+//          runs the stash in order and stops holding p.
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <string>
+
+struct Message {
+    enum Kind { data, hold, marker, release, stop };
+    Kind kind = data;
+    int partition = 0;
+    long long key = 0;
+    long long seq = 0; // Per-key sequence number, to check ordering.
+};
+
+// A lane's queue. Its consumer takes everything that's queued under one lock.
+class LaneQueue {
+public:
+    void push(Message m) {
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            items.push_back(m);
+        }
+        cv.notify_one();
+    }
+
+    void drain_into(std::deque<Message>& out) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this] { return !items.empty(); });
+        out.swap(items);
+    }
+
+private:
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<Message> items;
+};
+
+// Shared by all lanes: the "business logic" and an ordering check.
+struct Processing {
+    explicit Processing(long long num_keys) : last_seq(num_keys) {
+        for (auto& s : last_seq) {
+            s.store(-1);
+        }
+    }
+
+    void process(const Message& m) {
+        // Simulated work: a couple of microseconds of CPU.
+        volatile unsigned long long h = static_cast<unsigned long long>(m.key);
+        for (int i = 0; i < 400; ++i) {
+            h = h * 6364136223846793005ULL + 1442695040888963407ULL;
+        }
+        // Exchange so the check is itself race-free even when the ordering is broken.
+        long long previous = last_seq[m.key].exchange(m.seq);
+        if (m.seq < previous) {
+            ++out_of_order;
+        }
+    }
+
+    std::vector<std::atomic<long long>> last_seq;
+    std::atomic<long long> out_of_order{0};
+};
+
+class PartitionedDispatcher {
+public:
+    PartitionedDispatcher(int num_lanes, int num_partitions, Processing& processing)
+        : owner(num_partitions), recent(num_partitions, 0), migrating(num_partitions), lanes(num_lanes),
+          processed(num_lanes, 0), processing(processing) {
+        // Start with partitions spread round-robin over the lanes.
+        for (int p = 0; p < num_partitions; ++p) {
+            owner[p] = p % num_lanes;
+        }
+        for (int i = 0; i < num_lanes; ++i) {
+            threads.emplace_back([this, i] { run_lane(i); });
+        }
+    }
+
+    // Single dispatching thread: owner[] and recent[] are only touched here.
+    void dispatch(long long key, long long seq) {
+        int p = static_cast<int>(std::hash<long long>{}(key) % owner.size());
+        ++recent[p];
+        lanes[owner[p]].push({Message::data, p, key, seq});
+    }
+
+    // Moves one partition off the busiest lane if that evens out the recent load.
+    // Returns true if a partition moved.
+    bool rebalance() {
+        std::vector<long long> load(lanes.size(), 0);
+        for (size_t p = 0; p < owner.size(); ++p) {
+            load[owner[p]] += recent[p];
+        }
+        int busiest = static_cast<int>(std::max_element(load.begin(), load.end()) - load.begin());
+        int idlest = static_cast<int>(std::min_element(load.begin(), load.end()) - load.begin());
+        long long gap = load[busiest] - load[idlest];
+
+        // The ideal partition to move carries half the gap; moving it can't make things worse
+        // as long as it carries less than the whole gap.
+        int best = -1;
+        for (size_t p = 0; p < owner.size(); ++p) {
+            if (owner[p] == busiest && recent[p] > 0 && recent[p] < gap && !migrating[p].load() &&
+                (best < 0 || std::llabs(gap / 2 - recent[p]) < std::llabs(gap / 2 - recent[best]))) {
+                best = static_cast<int>(p);
+            }
+        }
+        // Forget old history gradually, so we follow shifts in the key distribution.
+        for (long long& r : recent) {
+            r /= 2;
+        }
+        if (best < 0) {
+            return false;
+        }
+
+        migrating[best].store(true);
+        lanes[idlest].push({Message::hold, best, 0, 0});
+        owner[best] = idlest;
+        lanes[busiest].push({Message::marker, best, 0, idlest});
+        ++migrations;
+        return true;
+    }
+
+    void shutdown() {
+        // Let in-flight handshakes finish, so no Release is sent to a lane that has stopped.
+        for (const std::atomic<bool>& m : migrating) {
+            while (m.load()) {
+                std::this_thread::yield();
+            }
+        }
+        for (LaneQueue& lane : lanes) {
+            lane.push({Message::stop, 0, 0, 0});
+        }
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
+
+    std::vector<long long> processed_per_lane() const { return processed; }
+    long long migrations = 0;
+
+private:
+    void run_lane(int self) {
+        LaneQueue& queue = lanes[self];
+        std::unordered_map<int, std::deque<Message>> held; // Partitions being handed to us.
+        std::deque<Message> batch;
+        while (true) {
+            queue.drain_into(batch);
+            for (const Message& m : batch) {
+                switch (m.kind) {
+                case Message::data: {
+                    auto it = held.find(m.partition);
+                    if (it != held.end()) {
+                        it->second.push_back(m);
+                    } else {
+                        processing.process(m);
+                        ++processed[self];
+                    }
+                    break;
+                }
+                case Message::hold:
+                    held[m.partition];
+                    break;
+                case Message::marker:
+                    // Everything queued here for this partition is done. Seq carries the new owner.
+                    lanes[m.seq].push({Message::release, m.partition, 0, 0});
+                    break;
+                case Message::release: {
+                    auto it = held.find(m.partition);
+                    for (const Message& h : it->second) {
+                        processing.process(h);
+                        ++processed[self];
+                    }
+                    held.erase(it);
+                    migrating[m.partition].store(false); // The dispatcher may move it again.
+                    break;
+                }
+                case Message::stop:
+                    return;
+                }
+            }
+            batch.clear();
+        }
+    }
+
+    std::vector<int> owner;          // partition -> lane. Dispatcher-only.
+    std::vector<long long> recent;   // Recent messages per partition. Dispatcher-only.
+    std::vector<std::atomic<bool>> migrating; // Set by the dispatcher, cleared on Release.
+    std::deque<LaneQueue> lanes;
+    std::vector<long long> processed; // Lane i only writes processed[i]; read after shutdown.
+    std::vector<std::thread> threads;
+    Processing& processing;
+};
+
+// --- Benchmark: a skewed (Zipf) key distribution ---
+
+// Zipf-distributed keys: key k has weight 1/(k+1)^s, so a few keys dominate.
+std::vector<long long> zipf_keys(long long num_keys, long long n, double s) {
+    std::vector<double> weights(num_keys);
+    for (long long k = 0; k < num_keys; ++k) {
+        weights[k] = 1.0 / std::pow(static_cast<double>(k + 1), s);
+    }
+    std::discrete_distribution<long long> dist(weights.begin(), weights.end());
+    std::mt19937_64 rng(7);
+    std::vector<long long> keys(n);
+    for (long long& k : keys) {
+        k = dist(rng);
+    }
+    return keys;
+}
+
+void bench_shared_queue(const std::vector<long long>& keys, long long num_keys, int consumers) {
+    Processing processing(num_keys);
+    std::deque<Message> q;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool finished = false;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int c = 0; c < consumers; ++c) {
+        threads.emplace_back([&] {
+            while (true) {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&] { return !q.empty() || finished; });
+                if (q.empty()) {
+                    return;
+                }
+                Message m = q.front();
+                q.pop_front();
+                lock.unlock();
+                processing.process(m);
+            }
+        });
+    }
+    std::vector<long long> next_seq(num_keys, 0);
+    for (long long key : keys) {
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            q.push_back({Message::data, 0, key, next_seq[key]++});
+        }
+        cv.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        finished = true;
+    }
+    cv.notify_all();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Shared queue, " << consumers << " consumers:  " << static_cast<long long>(keys.size() / seconds)
+              << " msgs/s, out-of-order " << processing.out_of_order << std::endl;
+}
+
+void bench_partitioned(const std::vector<long long>& keys, long long num_keys, int lanes, bool dynamic) {
+    Processing processing(num_keys);
+    PartitionedDispatcher dispatcher(lanes, 64, processing);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<long long> next_seq(num_keys, 0);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        dispatcher.dispatch(keys[i], next_seq[keys[i]]++);
+        if (dynamic && i % 4096 == 4095) {
+            dispatcher.rebalance();
+        }
+    }
+    dispatcher.shutdown();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << (dynamic ? "Partitioned + rebalancing: " : "Partitioned, static:       ")
+              << static_cast<long long>(keys.size() / seconds) << " msgs/s, out-of-order "
+              << processing.out_of_order << ", migrations " << dispatcher.migrations << ", per lane:";
+    for (long long n : dispatcher.processed_per_lane()) {
+        std::cout << " " << n;
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    long long n = argc > 1 ? std::stoll(argv[1]) : 500000;
+    const long long kKeys = 10000;
+    const int kConsumers = 4;
+
+    std::cout << "Benchmark: " << n << " messages over " << kKeys << " Zipf(1.1) keys, "
+              << kConsumers << " consumers" << std::endl;
+    std::vector<long long> keys = zipf_keys(kKeys, n, 1.1);
+    bench_shared_queue(keys, kKeys, kConsumers);
+    bench_partitioned(keys, kKeys, kConsumers, false);
+    bench_partitioned(keys, kKeys, kConsumers, true);
+    return 0;
+}
@@ -0,0 +1,492 @@
+// Pipeline-parallel stages, in the style of TBB's parallel_pipeline.
+// ConsumerProducer.cpp hard-codes exactly one producer/consumer pair over one global queue.
+// Here a pipeline is a chain of stages, and every stage declares how it may run:
+//   - serial_in_order:     one item at a time, in the order the input stage produced them.
+//   - serial_out_of_order: one item at a time, in whatever order items arrive.
+//   - parallel:            any number of items at the same time.
+// A token limit bounds how many items are in flight, which bounds memory use.
+// Stages have no queues between them: an item is carried through the stages by one ThreadPool
+// task for as long as it can keep going, and each serial stage only guards its own "busy" flag
+// and a small buffer of items that arrived while it was busy (or, for in-order stages, out of
+// turn). The pool itself still has one task queue behind one mutex, and every item passes
+// through it when the input stage dispatches it, and again each time a parked item is resumed.
+// If a stage (or the input) throws, the input stops, the items already in flight drain through
+// the remaining stages without running their bodies, and run() rethrows the first exception.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <queue>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <any>
+#include <string>
+#include <chrono>
+#include <random>
+#include <filesystem>
+#include <type_traits>
+
+// The same pool as ThreadPool.cpp.
+class ThreadPool {
+public:
+    ThreadPool(size_t num_threads) : stop(false) {
+        for (size_t i = 0; i < num_threads; ++i) {
+            workers.emplace_back([this] {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(this->queue_mutex);
+                        this->condition.wait(lock, [this] {
+                            return this->stop || !this->tasks.empty();
+                        });
+                        if (this->stop && this->tasks.empty()) {
+                            return;
+                        }
+                        task = std::move(this->tasks.front());
+                        this->tasks.pop();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    template<class F, class... Args>
+    auto submit(F&& f, Args&&... args) -> std::future<decltype(f(args...))> {
+        using return_type = decltype(f(args...));
+
+        auto task = std::make_shared<std::packaged_task<return_type()>>(
+            std::bind(std::forward<F>(f), std::forward<Args>(args)...)
+        );
+
+        std::future<return_type> res = task->get_future();
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+
+            if (stop) {
+                throw std::runtime_error("submit on stopped ThreadPool");
+            }
+
+            tasks.emplace([task](){ (*task)(); });
+        }
+        condition.notify_one();
+        return res;
+    }
+
+    ~ThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            stop = true;
+        }
+        condition.notify_all();
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+
+    std::mutex queue_mutex;
+    std::condition_variable condition;
+    bool stop;
+};
+
+enum class StageMode { serial_in_order, serial_out_of_order, parallel };
+
+// Handed to the input stage so it can say "there is nothing more to read".
+// The value returned by the call that calls stop() is discarded.
+class FlowControl {
+public:
+    void stop() { stopped = true; }
+    bool is_stopped() const { return stopped; }
+private:
+    bool stopped = false;
+};
+
+class Pipeline {
+public:
+    Pipeline(ThreadPool& pool, size_t max_tokens) : pool(pool), max_tokens(max_tokens) {}
+
+    // The input stage is always serial and in order: it is what defines "the order".
+    // f has the signature Out(FlowControl&).
+    template<class F>
+    Pipeline& input(F f) {
+        input_body = [f](FlowControl& fc) -> std::any { return f(fc); };
+        return *this;
+    }
+
+    // A middle or final stage. f has the signature Out(In); use Out = void for the last stage.
+    template<class In, class Out, class F>
+    Pipeline& stage(StageMode mode, F f) {
+        auto state = std::make_unique<StageState>();
+        state->mode = mode;
+        state->body = [f](std::any&& value) -> std::any {
+            if constexpr (std::is_void_v<Out>) {
+                f(std::any_cast<In&&>(std::move(value)));
+                return {};
+            } else {
+                return f(std::any_cast<In&&>(std::move(value)));
+            }
+        };
+        stages.push_back(std::move(state));
+        return *this;
+    }
+
+    // Runs the pipeline until the input stage stops and every item has left the last stage.
+    // Rethrows the first exception a stage threw, once every item has drained.
+    void run() {
+        for (auto& s : stages) {
+            s->busy = false;
+            s->next_seq = 0;
+        }
+        {
+            std::lock_guard<std::mutex> guard(input_mtx);
+            in_flight = 0;
+            next_input_seq = 0;
+            input_done = false;
+            input_running = true;
+            error = nullptr;
+            failed = false;
+        }
+        pool.submit([this] { pump_input(); });
+
+        std::unique_lock<std::mutex> lock(input_mtx);
+        done_cv.wait(lock, [this] { return input_done && !input_running && in_flight == 0; });
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    struct StageState {
+        StageMode mode;
+        std::function<std::any(std::any&&)> body;
+
+        std::mutex mtx; // Guards the fields below. Never held while the body runs.
+        bool busy = false;
+        size_t next_seq = 0;                 // Only used by serial_in_order stages.
+        std::map<size_t, std::any> waiting;  // Items parked until the stage is free.
+    };
+
+    // Pulls items from the input stage until the stream ends or all tokens are in use.
+    // At most one pump_input() runs at a time, which keeps the input stage serial.
+    void pump_input() {
+        while (true) {
+            size_t seq;
+            {
+                std::lock_guard<std::mutex> guard(input_mtx);
+                if (failed) {
+                    input_done = true;
+                }
+                if (input_done || in_flight >= max_tokens) {
+                    // finish_item() restarts us once a token comes back.
+                    input_running = false;
+                    if (input_done && in_flight == 0) {
+                        done_cv.notify_all();
+                    }
+                    return;
+                }
+                ++in_flight;
+                seq = next_input_seq++;
+            }
+
+            FlowControl fc;
+            std::any value;
+            try {
+                value = input_body(fc);
+            } catch (...) {
+                fail(std::current_exception());
+                fc.stop();
+            }
+
+            if (fc.is_stopped()) {
+                std::lock_guard<std::mutex> guard(input_mtx);
+                input_done = true;
+                input_running = false;
+                --in_flight;
+                if (in_flight == 0) {
+                    done_cv.notify_all();
+                }
+                return;
+            }
+
+            pool.submit([this, seq, value = std::move(value)]() mutable {
+                run_from(seq, std::move(value), 0, false);
+            });
+        }
+    }
+
+    // Carries one item through the stages, starting at stage idx.
+    // granted == true means the caller already owns stage idx (it was resumed from the buffer).
+    void run_from(size_t seq, std::any value, size_t idx, bool granted) {
+        while (idx < stages.size()) {
+            StageState& s = *stages[idx];
+
+            if (s.mode == StageMode::parallel) {
+                value = call_body(s, std::move(value));
+                ++idx;
+                continue;
+            }
+
+            if (!granted) {
+                std::lock_guard<std::mutex> guard(s.mtx);
+                bool my_turn = !s.busy &&
+                    (s.mode == StageMode::serial_out_of_order || seq == s.next_seq);
+                if (!my_turn) {
+                    // Park the item. Whoever releases the stage will resume it.
+                    s.waiting.emplace(seq, std::move(value));
+                    return;
+                }
+                s.busy = true;
+            }
+            granted = false;
+
+            value = call_body(s, std::move(value));
+
+            // Release the stage, handing it straight to the next eligible parked item.
+            bool has_next = false;
+            size_t next_seq = 0;
+            std::any next_value;
+            {
+                std::lock_guard<std::mutex> guard(s.mtx);
+                s.next_seq = seq + 1;
+                auto it = s.mode == StageMode::serial_in_order
+                    ? s.waiting.find(s.next_seq)
+                    : s.waiting.begin();
+                if (it != s.waiting.end()) {
+                    has_next = true;
+                    next_seq = it->first;
+                    next_value = std::move(it->second);
+                    s.waiting.erase(it);
+                } else {
+                    s.busy = false;
+                }
+            }
+            if (has_next) {
+                pool.submit([this, idx, next_seq, next_value = std::move(next_value)]() mutable {
+                    run_from(next_seq, std::move(next_value), idx, true);
+                });
+            }
+            ++idx;
+        }
+        finish_item();
+    }
+
+    // Once anything has thrown, items still take their turns at every stage, so in-order stages
+    // keep advancing and parked items get resumed, but no more bodies run.
+    std::any call_body(StageState& s, std::any&& value) {
+        if (failed.load(std::memory_order_relaxed)) {
+            return {};
+        }
+        try {
+            return s.body(std::move(value));
+        } catch (...) {
+            fail(std::current_exception());
+            return {};
+        }
+    }
+
+    // Keeps the first exception for run() to rethrow, and stops the input stage.
+    void fail(std::exception_ptr e) {
+        std::lock_guard<std::mutex> guard(input_mtx);
+        if (!error) {
+            error = e;
+        }
+        failed = true;
+    }
+
+    // Returns the item's token and restarts the input stage if it was waiting for one.
+    void finish_item() {
+        std::lock_guard<std::mutex> guard(input_mtx);
+        --in_flight;
+        if (!input_done && !input_running) {
+            input_running = true;
+            pool.submit([this] { pump_input(); });
+        }
+        if (input_done && !input_running && in_flight == 0) {
+            done_cv.notify_all();
+        }
+    }
+
+    ThreadPool& pool;
+    size_t max_tokens;
+    std::function<std::any(FlowControl&)> input_body;
+    std::vector<std::unique_ptr<StageState>> stages;
+
+    std::mutex input_mtx; // Owned by the input stage: guards the token count and run state.
+    std::condition_variable done_cv;
+    size_t in_flight = 0;
+    size_t next_input_seq = 0;
+    bool input_done = false;
+    bool input_running = false;
+    std::exception_ptr error;        // The first exception thrown, guarded by input_mtx.
+    std::atomic<bool> failed{false}; // error is set. Read without the lock by call_body().
+};
+
+// --- Benchmark: read -> parse -> transform -> write over a large local file ---
+
+using Lines = std::vector<std::string>;
+using Records = std::vector<std::pair<long long, long long>>;
+
+const size_t kLinesPerChunk = 4096;
+
+void generate_input(const std::string& path, size_t num_lines) {
+    std::ofstream out(path);
+    std::mt19937_64 rng(42);
+    for (size_t i = 0; i < num_lines; ++i) {
+        out << i << ',' << (rng() % 1000000) << '\n';
+    }
+}
+
+Lines read_chunk(std::ifstream& in, FlowControl& fc) {
+    Lines lines;
+    lines.reserve(kLinesPerChunk);
+    std::string line;
+    while (lines.size() < kLinesPerChunk && std::getline(in, line)) {
+        lines.push_back(std::move(line));
+    }
+    if (lines.empty()) {
+        fc.stop();
+    }
+    return lines;
+}
+
+Records parse_chunk(const Lines& lines) {
+    Records records;
+    records.reserve(lines.size());
+    for (const std::string& line : lines) {
+        size_t comma = line.find(',');
+        records.emplace_back(std::stoll(line.substr(0, comma)), std::stoll(line.substr(comma + 1)));
+    }
+    return records;
+}
+
+// Some CPU work per record, so the parallel stages have something to parallelize.
+std::string transform_chunk(const Records& records) {
+    std::ostringstream out;
+    for (const auto& r : records) {
+        unsigned long long h = static_cast<unsigned long long>(r.second);
+        for (int round = 0; round < 64; ++round) {
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+        }
+        out << r.first << ',' << r.second << ',' << (h % 1000) << '\n';
+    }
+    return out.str();
+}
+
+double run_sequential(const std::string& in_path, const std::string& out_path) {
+    auto start = std::chrono::steady_clock::now();
+    std::ifstream in(in_path);
+    std::ofstream out(out_path);
+    while (true) {
+        FlowControl fc;
+        Lines lines = read_chunk(in, fc);
+        if (fc.is_stopped()) {
+            break;
+        }
+        out << transform_chunk(parse_chunk(lines));
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double run_pipeline(const std::string& in_path, const std::string& out_path,
+                    size_t num_threads, size_t max_tokens, size_t& records_seen) {
+    auto start = std::chrono::steady_clock::now();
+    records_seen = 0;
+    std::ifstream in(in_path);
+    std::ofstream out(out_path);
+    {
+        ThreadPool pool(num_threads);
+        Pipeline pipeline(pool, max_tokens);
+        pipeline
+            .input([&in](FlowControl& fc) { return read_chunk(in, fc); })
+            .stage<Lines, Records>(StageMode::parallel, parse_chunk)
+            // Serial, so the plain counter needs no lock; order does not matter for a sum.
+            .stage<Records, Records>(StageMode::serial_out_of_order,
+                                     [&records_seen](Records records) {
+                                         records_seen += records.size();
+                                         return records;
+                                     })
+            .stage<Records, std::string>(StageMode::parallel, transform_chunk)
+            .stage<std::string, void>(StageMode::serial_in_order,
+                                      [&out](const std::string& text) { out << text; });
+        pipeline.run();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string slurp(const std::string& path) {
+    std::ifstream in(path);
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+int main(int argc, char* argv[]) {
+    size_t num_lines = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    size_t num_threads = std::max(2u, std::thread::hardware_concurrency());
+
+    auto dir = std::filesystem::temp_directory_path();
+    std::string in_path = (dir / "pipeline_input.csv").string();
+    std::string seq_path = (dir / "pipeline_sequential.csv").string();
+    std::string par_path = (dir / "pipeline_parallel.csv").string();
+
+    std::cout << "Generating " << num_lines << " lines..." << std::endl;
+    generate_input(in_path, num_lines);
+    std::cout << "Input size: " << std::filesystem::file_size(in_path) / (1024 * 1024) << " MiB" << std::endl;
+
+    double seq_time = run_sequential(in_path, seq_path);
+    std::cout << "Sequential: " << seq_time << " s" << std::endl;
+    std::string expected = slurp(seq_path);
+
+    for (size_t tokens : {1, 2, 4, 16}) {
+        size_t records_seen = 0;
+        double t = run_pipeline(in_path, par_path, num_threads, tokens, records_seen);
+        bool same = slurp(par_path) == expected && records_seen == num_lines;
+        std::cout << "Pipeline (" << num_threads << " threads, " << tokens << " tokens): "
+                  << t << " s, speedup " << seq_time / t << "x, output "
+                  << (same ? "identical" : "MISMATCH") << std::endl;
+    }
+
+    // A stage that throws: run() still returns once the items in flight have drained, and
+    // rethrows the stage's exception.
+    {
+        ThreadPool pool(num_threads);
+        Pipeline pipeline(pool, 4);
+        int next = 0;
+        pipeline
+            .input([&next](FlowControl& fc) {
+                if (next == 100) {
+                    fc.stop();
+                }
+                return next++;
+            })
+            .stage<int, int>(StageMode::parallel, [](int i) {
+                if (i == 42) {
+                    throw std::runtime_error("bad item " + std::to_string(i));
+                }
+                return i;
+            })
+            .stage<int, void>(StageMode::serial_in_order, [](int) {});
+        try {
+            pipeline.run();
+        } catch (const std::runtime_error& e) {
+            std::cout << "Stage error: " << e.what() << std::endl;
+        }
+    }
+
+    std::filesystem::remove(in_path);
+    std::filesystem::remove(seq_path);
+    std::filesystem::remove(par_path);
+    return 0;
+}
@@ -0,0 +1,434 @@
+// Read-copy-update (RCU) for read-mostly data such as routing and config tables.
+// LockGuard.cpp takes a std::mutex for every access. For a table that every task reads and
+// almost nobody writes, that's a lot of lock traffic just to read. std::shared_mutex lets the
+// readers in together, but each of them still writes the shared reader count. RCU readers write
+// nothing shared at all:
+//   - The table lives behind an atomic pointer. A reader loads the pointer and reads the table
+//     it points to. That's the whole read side: wait-free, no lock, no counter.
+//   - A writer never changes a published table. It copies it, changes the copy, and swaps the
+//     pointer. Readers that loaded the old pointer keep using the old table.
+//   - The old table can be freed once every reader that might still be using it is done. That
+//     wait is the grace period.
+// This is the quiescent-state flavour (QSBR) of userspace RCU. Each registered reader thread
+// reports a quiescent state when it holds no pointers into RCU-protected data, e.g. between two
+// tasks. For that it copies the global epoch into its own padded slot. synchronize() bumps the
+// epoch and waits until every online reader has copied the new value (or gone offline). A thread
+// about to block for a while, like an idle ThreadPool worker, goes offline, so writers don't wait
+// for it.
+// ThreadPool below does all of this for its workers: online at start, a quiescent state after
+// every task, offline while waiting for work. Tasks just call read() and must not keep the
+// pointer after they return.
+// Rules for threads outside the pool: call Rcu::online() before the first read, report quiescent
+// states regularly, and go offline before blocking. Never call synchronize() while holding an
+// RCU pointer yourself. Writers may be readers too: update() and synchronize() take the calling
+// thread offline while they wait, so concurrent writers, e.g. two pool tasks, can't deadlock.
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <vector>
+#include <queue>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+class Rcu {
+public:
+    static const int kMaxThreads = 128;
+
+    // Registers the calling thread as a reader that may now hold RCU pointers.
+    static void online() {
+        Slot& s = slot();
+        // seq_cst: the slot must be visible to writers before this thread loads any pointer.
+        s.seen.store(epoch.load(), std::memory_order_seq_cst);
+    }
+
+    // The calling thread won't read RCU data until it calls online() again.
+    static void offline() { slot().seen.store(kOffline, std::memory_order_release); }
+
+    // The calling thread holds no RCU pointers right now.
+    static void quiescent_state() {
+        Slot& s = slot();
+        uint64_t e = epoch.load(std::memory_order_acquire);
+        uint64_t seen = s.seen.load(std::memory_order_relaxed);
+        if (seen != kOffline && seen != e) { // Nothing to report if no writer is waiting.
+            s.seen.store(e, std::memory_order_release);
+        }
+    }
+
+    // Waits until every reader that was online when it was called has passed a quiescent state.
+    // The caller goes offline while it waits (and while it waits for another writer), so two
+    // online threads calling this at once don't each wait for the other's slot. It must not hold
+    // RCU pointers, and it's back online, if it was, when this returns.
+    static void synchronize() {
+        OfflineScope offline;
+        synchronize_offline();
+    }
+
+    // Goes offline for its lifetime if the calling thread was online, and back online afterwards.
+    class OfflineScope {
+    public:
+        OfflineScope() : was_online(slot().seen.load(std::memory_order_relaxed) != kOffline) {
+            if (was_online) {
+                offline();
+            }
+        }
+        ~OfflineScope() {
+            if (was_online) {
+                online();
+            }
+        }
+        OfflineScope(const OfflineScope&) = delete;
+        OfflineScope& operator=(const OfflineScope&) = delete;
+
+    private:
+        bool was_online;
+    };
+
+    // synchronize() for a caller that is already offline.
+    static void synchronize_offline() {
+        std::lock_guard<std::mutex> guard(writer_mutex);
+        uint64_t target = epoch.fetch_add(1) + 1;
+        for (const Slot& s : slots) {
+            uint64_t seen;
+            while ((seen = s.seen.load()) != kOffline && seen < target) {
+                std::this_thread::yield();
+            }
+        }
+        grace_periods.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static long long completed_grace_periods() { return grace_periods.load(); }
+
+private:
+    static constexpr uint64_t kOffline = 0;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> seen{kOffline}; // The last epoch this reader saw, or kOffline.
+        std::atomic<bool> taken{false};
+    };
+
+    // Takes a slot on first use and gives it back, offline, when the thread exits.
+    struct Registration {
+        Slot* s = nullptr;
+        Registration() {
+            for (Slot& candidate : slots) {
+                bool expected = false;
+                if (candidate.taken.compare_exchange_strong(expected, true)) {
+                    s = &candidate;
+                    return;
+                }
+            }
+            throw std::runtime_error("Rcu: too many reader threads");
+        }
+        ~Registration() {
+            s->seen.store(kOffline, std::memory_order_release);
+            s->taken.store(false, std::memory_order_release);
+        }
+    };
+
+    static Slot& slot() {
+        thread_local Registration r;
+        return *r.s;
+    }
+
+    static Slot slots[kMaxThreads];
+    static std::atomic<uint64_t> epoch;
+    static std::atomic<long long> grace_periods;
+    static std::mutex writer_mutex;
+};
+
+Rcu::Slot Rcu::slots[Rcu::kMaxThreads];
+std::atomic<uint64_t> Rcu::epoch{1};
+std::atomic<long long> Rcu::grace_periods{0};
+std::mutex Rcu::writer_mutex;
+
+// An RCU-protected T. Readers call read(); writers call update() with a function that edits a
+// copy.
+template<class T>
+class RcuPtr {
+public:
+    explicit RcuPtr(T initial) : ptr(new T(std::move(initial))) {}
+    ~RcuPtr() { delete ptr.load(); }
+
+    RcuPtr(const RcuPtr&) = delete;
+    RcuPtr& operator=(const RcuPtr&) = delete;
+
+    // Valid until the calling thread's next quiescent state. seq_cst pairs with online(); on x86
+    // and ARMv8 it's the same instruction as an acquire load.
+    const T* read() const { return ptr.load(std::memory_order_seq_cst); }
+
+    // Copies the current value, applies edit to the copy, publishes it, and frees the old one
+    // after a grace period. Blocks for that grace period; writers are serialized. The caller is
+    // offline from before it waits for update_mutex until the old value is freed: a writer
+    // queued on the mutex mustn't be a reader the current writer's grace period waits for.
+    template<class Edit>
+    void update(Edit edit) {
+        Rcu::OfflineScope offline;
+        std::lock_guard<std::mutex> guard(update_mutex);
+        T* old = ptr.load(std::memory_order_relaxed); // Only update_mutex's holder frees it.
+        T* fresh = new T(*old);
+        edit(*fresh);
+        ptr.store(fresh, std::memory_order_seq_cst);
+        Rcu::synchronize_offline();
+        delete old;
+    }
+
+private:
+    std::atomic<T*> ptr;
+    std::mutex update_mutex;
+};
+
+// --- ThreadPool.cpp's pool, with its workers reporting quiescent states ---
+
+class ThreadPool {
+public:
+    ThreadPool(size_t num_threads) : stop(false) {
+        for (size_t i = 0; i < num_threads; ++i) {
+            workers.emplace_back([this] {
+                Rcu::online();
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(this->queue_mutex);
+                        if (!this->stop && this->tasks.empty()) {
+                            // Idle workers mustn't hold up writers' grace periods.
+                            Rcu::offline();
+                            this->condition.wait(lock, [this] { return this->stop || !this->tasks.empty(); });
+                            Rcu::online();
+                        }
+                        if (this->stop && this->tasks.empty()) {
+                            Rcu::offline();
+                            return;
+                        }
+                        task = std::move(this->tasks.front());
+                        this->tasks.pop();
+                    }
+                    task();
+                    Rcu::quiescent_state(); // Tasks don't keep RCU pointers.
+                }
+            });
+        }
+    }
+
+    template<class F, class... Args>
+    auto submit(F&& f, Args&&... args) -> std::future<decltype(f(args...))> {
+        using return_type = decltype(f(args...));
+        auto task = std::make_shared<std::packaged_task<return_type()>>(
+            std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+        std::future<return_type> res = task->get_future();
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            if (stop) {
+                throw std::runtime_error("submit on stopped ThreadPool");
+            }
+            tasks.emplace([task]() { (*task)(); });
+        }
+        condition.notify_one();
+        return res;
+    }
+
+    ~ThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            stop = true;
+        }
+        condition.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+
+    std::mutex queue_mutex;
+    std::condition_variable condition;
+    bool stop;
+};
+
+// --- Benchmark: reading a routing table, with an update every millisecond ---
+
+// Every table has version == sum of its routes, so a reader can tell if it saw a half-written one.
+struct RoutingTable {
+    static const int kRoutes = 64;
+    long long routes[kRoutes] = {};
+    long long version = 0;
+
+    static std::atomic<long long> live; // Tables not yet freed.
+    RoutingTable() { ++live; }
+    RoutingTable(const RoutingTable& o) : version(o.version) {
+        std::copy(o.routes, o.routes + kRoutes, routes);
+        ++live;
+    }
+    ~RoutingTable() { --live; }
+
+    void bump(long long key) {
+        routes[key % kRoutes]++;
+        version++;
+    }
+
+    bool consistent() const {
+        long long sum = 0;
+        for (long long r : routes) {
+            sum += r;
+        }
+        return sum == version;
+    }
+};
+
+std::atomic<long long> RoutingTable::live{0};
+
+struct Result {
+    double reads_per_sec;
+    long long bad; // Inconsistent tables seen.
+};
+
+// Each reader thread looks up a route per "task" and checks a whole table every 256 tasks; every
+// 64 tasks it calls `between_tasks` (the RCU variant reports a quiescent state there). One writer
+// updates the table every millisecond.
+template<class Read, class Write, class Between>
+Result run(int threads, std::chrono::milliseconds duration, Read read, Write write, Between between_tasks) {
+    std::atomic<bool> go{false}, stop{false};
+    std::atomic<long long> reads{0}, bad{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < threads; ++t) {
+        readers.emplace_back([&, t] {
+            Rcu::online();
+            long long n = 0, my_bad = 0, sink = 0;
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            while (!stop.load(std::memory_order_relaxed)) {
+                read([&](const RoutingTable& table) {
+                    sink += table.routes[(n * 7 + t) % RoutingTable::kRoutes];
+                    if (n % 256 == 0 && !table.consistent()) {
+                        ++my_bad;
+                    }
+                });
+                if (++n % 64 == 0) {
+                    between_tasks();
+                }
+            }
+            Rcu::offline();
+            reads += n;
+            bad += my_bad + (sink < 0);
+        });
+    }
+    std::thread writer([&] {
+        while (!go.load()) {
+            std::this_thread::yield();
+        }
+        for (long long i = 0; !stop.load(); ++i) {
+            write(i);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (std::thread& r : readers) {
+        r.join();
+    }
+    writer.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return {static_cast<double>(reads.load()) / seconds, bad.load()};
+}
+
+int main(int argc, char* argv[]) {
+    std::chrono::milliseconds duration(argc > 1 ? std::stoi(argv[1]) : 200);
+
+    {
+        // Pool workers read the live table in every task while main keeps publishing new ones.
+        RcuPtr<RoutingTable> table{RoutingTable()};
+        ThreadPool pool(4);
+        std::vector<std::future<bool>> results;
+        for (int i = 0; i < 2000; ++i) {
+            results.push_back(pool.submit([&table] { return table.read()->consistent(); }));
+            if (i % 100 == 0) {
+                table.update([i](RoutingTable& t) { t.bump(i); });
+            }
+        }
+        int ok = 0;
+        for (auto& r : results) {
+            ok += r.get();
+        }
+        std::cout << "ThreadPool: " << ok << "/2000 tasks saw a consistent table, " << Rcu::completed_grace_periods()
+                  << " grace periods, " << RoutingTable::live.load() << " table(s) alive" << std::endl;
+    }
+
+    {
+        // Writers that are also online readers: pool tasks updating the same table, and another,
+        // at the same time. Each edit is slow, so updates queue on the mutexes while others wait
+        // for their grace period.
+        RcuPtr<RoutingTable> a{RoutingTable()}, b{RoutingTable()};
+        {
+            ThreadPool pool(4);
+            std::vector<std::future<void>> updates;
+            for (int i = 0; i < 16; ++i) {
+                updates.push_back(pool.submit([&, i] {
+                    RcuPtr<RoutingTable>& target = i % 4 == 3 ? b : a;
+                    target.update([i](RoutingTable& t) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                        t.bump(i);
+                    });
+                }));
+            }
+            for (auto& u : updates) {
+                u.get();
+            }
+        }
+        bool ok = a.read()->version == 12 && b.read()->version == 4 && a.read()->consistent();
+        std::cout << "ThreadPool: 16 concurrent updates from pool tasks " << (ok ? "ok" : "WRONG") << std::endl;
+    }
+
+    std::cout << "Benchmark: " << duration.count() << " ms per run, one update per ms, "
+              << std::thread::hardware_concurrency() << " hardware threads. Million reads/s (inconsistent reads)"
+              << std::endl;
+    std::cout << "threads   std::mutex  std::shared_mutex  atomic shared_ptr          RCU" << std::endl;
+    auto nothing = [] {};
+    for (int threads : {1, 2, 4, 8, 16}) {
+        RoutingTable plain;
+        std::mutex m;
+        Result exclusive = run(threads, duration,
+            [&](auto use) { std::lock_guard<std::mutex> g(m); use(plain); },
+            [&](long long i) { std::lock_guard<std::mutex> g(m); plain.bump(i); }, nothing);
+
+        std::shared_mutex sm;
+        Result shared = run(threads, duration,
+            [&](auto use) { std::shared_lock<std::shared_mutex> g(sm); use(plain); },
+            [&](long long i) { std::lock_guard<std::shared_mutex> g(sm); plain.bump(i); }, nothing);
+
+        // Copy-on-write with std::shared_ptr: readers pin the table with a reference count.
+        std::shared_ptr<const RoutingTable> current = std::make_shared<RoutingTable>();
+        Result sp = run(threads, duration,
+            [&](auto use) { use(*std::atomic_load(&current)); },
+            [&](long long i) {
+                auto fresh = std::make_shared<RoutingTable>(*std::atomic_load(&current));
+                fresh->bump(i);
+                std::atomic_store(&current, std::shared_ptr<const RoutingTable>(std::move(fresh)));
+            }, nothing);
+
+        RcuPtr<RoutingTable> rcu{RoutingTable()};
+        Result rc = run(threads, duration,
+            [&](auto use) { use(*rcu.read()); },
+            [&](long long i) { rcu.update([i](RoutingTable& t) { t.bump(i); }); }, [] { Rcu::quiescent_state(); });
+
+        char line[160];
+        std::snprintf(line, sizeof(line), "%7d %8.1f (%lld) %12.1f (%lld) %14.1f (%lld) %8.1f (%lld)", threads,
+                      exclusive.reads_per_sec / 1e6, exclusive.bad, shared.reads_per_sec / 1e6, shared.bad,
+                      sp.reads_per_sec / 1e6, sp.bad, rc.reads_per_sec / 1e6, rc.bad);
+        std::cout << line << std::endl;
+    }
+    std::cout << "Tables alive at exit: " << RoutingTable::live.load() << std::endl;
+    return 0;
+}
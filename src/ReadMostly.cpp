@@ -0,0 +1,176 @@
+// Synchronization for read-mostly shared state: a scalable reader-writer lock and a seqlock.
+// LockGuard.cpp guards its state with an exclusive std::mutex, so readers wait for each other even
+// though they never conflict. std::shared_mutex lets them in together, but every lock_shared()
+// still increments one shared reader count: the cache line holding it bounces between all the
+// reading cores, and read throughput stops growing after a few threads.
+//   - RwLock: each reader announces itself in its own padded slot instead (a per-thread reader
+//     indicator; per-thread rather than per-CPU, so a reader that migrates mid-section still
+//     decrements the slot it incremented). Readers only touch their own line, plus one read of
+//     the writer flag, which stays shared in every reader's cache as long as nobody writes.
+//     A writer raises the flag and waits for every slot to drain. Writes get much more
+//     expensive, which is the right trade when they're 0.1% of the operations.
+//   - SeqLock<T>: for small, trivially copyable snapshots. Readers take no lock at all: they read
+//     a sequence number, copy the data, and read the sequence number again. If a writer was
+//     active (odd number) or finished in between (number changed), they retry. Readers never
+//     write to shared memory, so they scale perfectly; the price is that a read can be retried.
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include "locks/RwLock.h"
+
+// --- Seqlock ---
+
+template<class T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock copies T byte-wise");
+
+public:
+    explicit SeqLock(const T& initial = T()) { write(initial); }
+
+    T read() const {
+        uint64_t buf[kWords];
+        while (true) {
+            unsigned s1 = seq.load(std::memory_order_acquire);
+            if (s1 & 1) {
+                std::this_thread::yield(); // Writer in progress.
+                continue;
+            }
+            // The data is stored as relaxed atomic words, so reading it while a writer changes it
+            // is a stale read we then discard, not a data race.
+            for (size_t i = 0; i < kWords; ++i) {
+                buf[i] = words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq.load(std::memory_order_relaxed) == s1) {
+                T out;
+                std::memcpy(&out, buf, sizeof(T));
+                return out;
+            }
+        }
+    }
+
+    void write(const T& value) {
+        std::lock_guard<std::mutex> guard(writer_mutex);
+        uint64_t buf[kWords] = {};
+        std::memcpy(buf, &value, sizeof(T));
+        unsigned s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed); // Odd: write in progress.
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < kWords; ++i) {
+            words[i].store(buf[i], std::memory_order_relaxed);
+        }
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+private:
+    static const size_t kWords = (sizeof(T) + 7) / 8;
+    alignas(64) std::atomic<unsigned> seq{0};
+    std::atomic<uint64_t> words[kWords];
+    std::mutex writer_mutex;
+};
+
+// --- Benchmark: read throughput with 0.1% writes ---
+
+// Shared state with an invariant, so torn reads would show up: total == a + b + c.
+struct Config {
+    long long a = 0, b = 0, c = 0, total = 0;
+};
+
+void update(Config& cfg, long long v) {
+    cfg.a = v;
+    cfg.b = v * 2;
+    cfg.c = v * 3;
+    cfg.total = v * 6;
+}
+
+struct Result {
+    double reads_per_sec;
+    long long torn;
+};
+
+// Each thread does one write per `1 / write_rate` operations on average, reads otherwise.
+template<class Read, class Write>
+Result run(int threads, double write_rate, std::chrono::milliseconds duration, Read read, Write write) {
+    std::atomic<bool> go{false}, stop{false};
+    std::atomic<long long> reads{0}, torn{0};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::mt19937 rng(t + 1);
+            std::uniform_real_distribution<double> coin(0, 1);
+            long long my_reads = 0, my_torn = 0;
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            while (!stop.load(std::memory_order_relaxed)) {
+                if (coin(rng) < write_rate) {
+                    write(static_cast<long long>(rng()));
+                } else {
+                    Config cfg = read();
+                    my_torn += cfg.a + cfg.b + cfg.c != cfg.total;
+                    ++my_reads;
+                }
+            }
+            reads += my_reads;
+            torn += my_torn;
+        });
+    }
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (std::thread& w : workers) {
+        w.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return {static_cast<double>(reads.load()) / seconds, torn.load()};
+}
+
+int main(int argc, char* argv[]) {
+    std::chrono::milliseconds duration(argc > 1 ? std::stoi(argv[1]) : 150);
+    const double kWriteRate = 0.001;
+    std::cout << "Benchmark: 0.1% writes, " << duration.count() << " ms per run, "
+              << std::thread::hardware_concurrency() << " hardware threads. Million reads/s (torn reads)" << std::endl;
+    std::cout << "threads   std::mutex  std::shared_mutex     RwLock    SeqLock" << std::endl;
+
+    for (int threads : {1, 2, 4, 8, 16, 32, 64}) {
+        Config plain;
+
+        std::mutex m;
+        Result exclusive = run(threads, kWriteRate, duration,
+            [&] { std::lock_guard<std::mutex> g(m); return plain; },
+            [&](long long v) { std::lock_guard<std::mutex> g(m); update(plain, v); });
+
+        std::shared_mutex sm;
+        Result shared = run(threads, kWriteRate, duration,
+            [&] { std::shared_lock<std::shared_mutex> g(sm); return plain; },
+            [&](long long v) { std::lock_guard<std::shared_mutex> g(sm); update(plain, v); });
+
+        RwLock rw;
+        Result striped = run(threads, kWriteRate, duration,
+            [&] { std::shared_lock<RwLock> g(rw); return plain; },
+            [&](long long v) { std::lock_guard<RwLock> g(rw); update(plain, v); });
+
+        SeqLock<Config> seq;
+        Result seqlock = run(threads, kWriteRate, duration,
+            [&] { return seq.read(); },
+            [&](long long v) { Config c; update(c, v); seq.write(c); });
+
+        char line[160];
+        std::snprintf(line, sizeof(line), "%7d %8.1f (%lld) %12.1f (%lld) %6.1f (%lld) %6.1f (%lld)", threads,
+                      exclusive.reads_per_sec / 1e6, exclusive.torn, shared.reads_per_sec / 1e6, shared.torn,
+                      striped.reads_per_sec / 1e6, striped.torn, seqlock.reads_per_sec / 1e6, seqlock.torn);
+        std::cout << line << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,466 @@
+// Safe memory reclamation for lock-free structures: hazard pointers and epoch-based reclamation
+// (EBR) behind one interface.
+// Atomic.cpp's primitives are enough to build lock-free structures such as the stack below, but
+// not to free their nodes. A thread that has just loaded `top` may be about to read top->next
+// when another thread pops that node, and if it's deleted right then, the read lands in freed
+// memory. (Or the address gets reused, and a CAS that should fail succeeds: the ABA problem.)
+// Both schemes delay the delete until no thread can still be reading the node:
+//   - Guard g;                     starts a read-side section,
+//   - p = R::protect(i, src);      loads src and makes p safe to dereference while g lives,
+//   - R::retire(p);                once p is unlinked: delete it when that's safe.
+// Retired nodes go on a per-thread list, and the expensive part, scanning, runs once per
+// kScanEvery retires, so its cost is amortized over many nodes.
+//   - HazardPointers (as in LockFreeQueue.cpp): protect() publishes the pointer in one of the
+//     thread's hazard slots and re-checks src. A scan frees every retired node that no slot
+//     holds. Readers pay a seq_cst store per protected pointer. In exchange at most
+//     threads * kSlots nodes are ever held back, however long a reader stalls.
+//   - EpochReclamation: a Guard records the global epoch in the thread's slot, and protect() is
+//     just a load. A node retired in epoch e can be freed once the global epoch reaches e + 2.
+//     The epoch only advances when every thread inside a Guard has seen the current one, so by
+//     then nobody can still hold a pointer from epoch e. Reads are nearly free, but one reader
+//     stalled inside a Guard stops the epoch, and then *nothing* gets freed: memory grows
+//     without bound.
+// Threads that exit hand their unfreed nodes to a shared orphan list, which later scans adopt.
+// free_orphans() frees that list outright, once no thread is reading (e.g. at shutdown).
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+const int kMaxThreads = 128;
+
+// A retired node and how to delete it, so one domain serves structures of any node type.
+struct Retired {
+    void* ptr;
+    void (*deleter)(void*);
+    uint64_t epoch; // EBR only.
+};
+
+// What every reclamation domain keeps per thread: a record other threads can see, claimed on first
+// use, plus a private retire list. Nodes still on the list at thread exit become orphans.
+template<class Record>
+class ThreadRecords {
+public:
+    static Record* records() {
+        static Record r[kMaxThreads];
+        return r;
+    }
+
+    struct Local {
+        Record* record = nullptr;
+        std::vector<Retired> retired;
+        int depth = 0;      // Nested Guards.
+        int since_scan = 0; // Retires since the last scan (EBR).
+
+        Local() {
+            for (int i = 0; i < kMaxThreads; ++i) {
+                bool expected = false;
+                if (records()[i].in_use.compare_exchange_strong(expected, true)) {
+                    record = &records()[i];
+                    return;
+                }
+            }
+            throw std::runtime_error("too many threads for the reclamation domain");
+        }
+
+        ~Local() {
+            if (!retired.empty()) {
+                std::lock_guard<std::mutex> guard(orphan_mtx());
+                orphans().insert(orphans().end(), retired.begin(), retired.end());
+            }
+            record->pending.store(0, std::memory_order_relaxed);
+            record->in_use.store(false, std::memory_order_release);
+        }
+    };
+
+    static Local& local() {
+        thread_local Local l;
+        return l;
+    }
+
+    // Moves orphaned nodes onto this thread's list, if nobody else is doing that right now.
+    static void adopt_orphans(std::vector<Retired>& into) {
+        std::unique_lock<std::mutex> lock(orphan_mtx(), std::try_to_lock);
+        if (lock.owns_lock() && !orphans().empty()) {
+            into.insert(into.end(), orphans().begin(), orphans().end());
+            orphans().clear();
+        }
+    }
+
+    // Frees everything exited threads left behind. Only when no thread is reading.
+    static void free_orphans() {
+        std::lock_guard<std::mutex> guard(orphan_mtx());
+        for (const Retired& r : orphans()) {
+            r.deleter(r.ptr);
+        }
+        orphans().clear();
+    }
+
+    // Retired but not yet freed, over all threads. Approximate while threads are retiring.
+    static long long pending() {
+        long long n = 0;
+        for (int i = 0; i < kMaxThreads; ++i) {
+            n += records()[i].pending.load(std::memory_order_relaxed);
+        }
+        std::lock_guard<std::mutex> guard(orphan_mtx());
+        return n + static_cast<long long>(orphans().size());
+    }
+
+private:
+    static std::mutex& orphan_mtx() {
+        static std::mutex m;
+        return m;
+    }
+
+    static std::vector<Retired>& orphans() {
+        static std::vector<Retired> o;
+        return o;
+    }
+};
+
+// Only the owning thread writes `pending`, so a load and store is enough.
+inline void set_pending(std::atomic<long long>& pending, size_t n) {
+    pending.store(static_cast<long long>(n), std::memory_order_relaxed);
+}
+
+// --- Hazard pointers ---
+
+class HazardPointers {
+public:
+    static constexpr int kSlots = 2;
+    static constexpr size_t kScanEvery = 2 * kMaxThreads * kSlots;
+
+private:
+    struct alignas(64) Record {
+        std::atomic<bool> in_use{false};
+        std::atomic<void*> hazards[kSlots] = {};
+        std::atomic<long long> pending{0};
+    };
+    using Records = ThreadRecords<Record>;
+
+public:
+    // Clears this thread's hazard slots when the read-side section ends. Guards nest, and only
+    // the outermost one clears, so an inner section (say, a pop() called while the caller holds
+    // a pointer of its own) can't drop the outer one's protection. The slots are still shared,
+    // though: nested code must protect through a different slot than the one it's nested in.
+    class Guard {
+    public:
+        Guard() : local(Records::local()) { ++local.depth; }
+        ~Guard() {
+            if (--local.depth == 0) {
+                for (auto& h : local.record->hazards) {
+                    h.store(nullptr, std::memory_order_release);
+                }
+            }
+        }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    private:
+        Records::Local& local;
+    };
+
+    // The re-check makes sure the pointer was still reachable *after* it became visible as a
+    // hazard, so a concurrent scan can't have missed it. Both are seq_cst: the hazard store must
+    // not be reordered after the re-load.
+    template<class T>
+    static T* protect(int slot, const std::atomic<T*>& src) {
+        std::atomic<void*>& hazard = Records::local().record->hazards[slot];
+        T* p = src.load();
+        while (true) {
+            hazard.store(p);
+            T* again = src.load();
+            if (again == p) {
+                return p;
+            }
+            p = again;
+        }
+    }
+
+    template<class T>
+    static void retire(T* node) {
+        Records::Local& l = Records::local();
+        l.retired.push_back({node, [](void* p) { delete static_cast<T*>(p); }, 0});
+        // A scan costs O(threads * kSlots); with at least twice that many nodes on the list, at
+        // least half of them get freed, so the cost per node stays constant.
+        if (l.retired.size() >= kScanEvery) {
+            Records::adopt_orphans(l.retired);
+            scan(l.retired);
+        }
+        set_pending(l.record->pending, l.retired.size());
+    }
+
+    static long long pending() { return Records::pending(); }
+    static void free_orphans() { Records::free_orphans(); }
+
+private:
+    // Frees every node in `list` that no hazard slot holds; keeps the rest.
+    static void scan(std::vector<Retired>& list) {
+        std::atomic_thread_fence(std::memory_order_seq_cst); // Our unlinks before the hazard reads.
+        std::vector<void*> held;
+        for (int i = 0; i < kMaxThreads; ++i) {
+            for (auto& h : Records::records()[i].hazards) {
+                if (void* p = h.load()) {
+                    held.push_back(p);
+                }
+            }
+        }
+        std::sort(held.begin(), held.end());
+        size_t kept = 0;
+        for (const Retired& r : list) {
+            if (std::binary_search(held.begin(), held.end(), r.ptr)) {
+                list[kept++] = r;
+            } else {
+                r.deleter(r.ptr);
+            }
+        }
+        list.resize(kept);
+    }
+};
+
+// --- Epoch-based reclamation ---
+
+class EpochReclamation {
+public:
+    static constexpr int kScanEvery = 64;
+
+private:
+    struct alignas(64) Record {
+        std::atomic<bool> in_use{false};
+        std::atomic<uint64_t> epoch{0}; // global epoch | kActive while in a Guard, else 0.
+        std::atomic<long long> pending{0};
+    };
+    using Records = ThreadRecords<Record>;
+
+public:
+    // Marks this thread active in the current epoch. Guards nest; only the outermost one counts.
+    class Guard {
+    public:
+        Guard() : local(Records::local()) {
+            if (local.depth++ == 0) {
+                // seq_cst: visible to anyone advancing the epoch before we load any pointer.
+                local.record->epoch.store(global_epoch.load() | kActive);
+            }
+        }
+        ~Guard() {
+            if (--local.depth == 0) {
+                local.record->epoch.store(0, std::memory_order_release);
+            }
+        }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    private:
+        Records::Local& local;
+    };
+
+    // Inside a Guard nothing retired meanwhile is freed, so a plain load is enough.
+    template<class T>
+    static T* protect(int, const std::atomic<T*>& src) {
+        return src.load(std::memory_order_acquire);
+    }
+
+    template<class T>
+    static void retire(T* node) {
+        Records::Local& l = Records::local();
+        l.retired.push_back({node, [](void* p) { delete static_cast<T*>(p); }, global_epoch.load()});
+        if (++l.since_scan >= kScanEvery) {
+            l.since_scan = 0;
+            size_t before = l.retired.size();
+            Records::adopt_orphans(l.retired);
+            if (l.retired.size() != before) {
+                // Keep the list in retire order, so scan() can stop at the first node that's too new.
+                std::stable_sort(l.retired.begin(), l.retired.end(),
+                                 [](const Retired& a, const Retired& b) { return a.epoch < b.epoch; });
+            }
+            try_advance();
+            scan(l.retired);
+        }
+        set_pending(l.record->pending, l.retired.size());
+    }
+
+    static long long pending() { return Records::pending(); }
+    static void free_orphans() { Records::free_orphans(); }
+
+private:
+    // The epoch counts in steps of 2, so the low bit of a thread's slot can say it's active.
+    static constexpr uint64_t kActive = 1;
+    static constexpr uint64_t kStep = 2;
+
+
+    // Advances the global epoch if every active thread has seen the current one.
+    static void try_advance() {
+        uint64_t e = global_epoch.load();
+        for (int i = 0; i < kMaxThreads; ++i) {
+            uint64_t seen = Records::records()[i].epoch.load();
+            if ((seen & kActive) && (seen & ~kActive) != e) {
+                return; // Someone is still reading in an older epoch.
+            }
+        }
+        global_epoch.compare_exchange_strong(e, e + kStep);
+    }
+
+    // Frees the nodes retired two or more epochs ago. The list is in retire order, so those are a
+    // prefix: while the epoch is stuck, a scan costs nothing however long the list grows.
+    static void scan(std::vector<Retired>& list) {
+        uint64_t e = global_epoch.load();
+        size_t n = 0;
+        while (n < list.size() && list[n].epoch + 2 * kStep <= e) {
+            list[n].deleter(list[n].ptr);
+            ++n;
+        }
+        list.erase(list.begin(), list.begin() + static_cast<std::ptrdiff_t>(n));
+    }
+
+    static std::atomic<uint64_t> global_epoch;
+};
+
+std::atomic<uint64_t> EpochReclamation::global_epoch{EpochReclamation::kStep};
+
+// --- A lock-free (Treiber) stack, generic over the reclamation scheme ---
+
+template<class T, class R>
+class LockFreeStack {
+public:
+    ~LockFreeStack() {
+        Node* n = top.load();
+        while (n) {
+            Node* next = n->next;
+            delete n;
+            n = next;
+        }
+    }
+
+    void push(T value) {
+        Node* n = new Node{std::move(value), top.load(std::memory_order_relaxed)};
+        while (!top.compare_exchange_weak(n->next, n, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+
+    bool pop(T& out) {
+        typename R::Guard guard;
+        while (true) {
+            Node* n = R::protect(0, top);
+            if (!n) {
+                return false;
+            }
+            // Safe: n can't be freed while protected, so neither the read nor the CAS sees a
+            // recycled address.
+            if (top.compare_exchange_strong(n, n->next, std::memory_order_acquire, std::memory_order_relaxed)) {
+                out = std::move(n->value);
+                R::retire(n);
+                return true;
+            }
+        }
+    }
+
+    // Keeps the top node protected for `stall`, like a reader that got descheduled mid-read.
+    void stall_reading(std::chrono::milliseconds stall) {
+        typename R::Guard guard;
+        R::protect(0, top);
+        std::this_thread::sleep_for(stall);
+    }
+
+private:
+    struct Node {
+        T value;
+        Node* next;
+    };
+    std::atomic<Node*> top{nullptr};
+};
+
+// --- Benchmark ---
+
+// Each thread pushes and pops `per_thread` times. Returns million pops per second.
+template<class R>
+double throughput(int threads, long long per_thread) {
+    LockFreeStack<long long, R> stack;
+    for (int i = 0; i < 1000; ++i) {
+        stack.push(i);
+    }
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            long long v;
+            for (long long i = 0; i < per_thread; ++i) {
+                stack.push(i);
+                stack.pop(v);
+            }
+        });
+    }
+    for (std::thread& w : workers) {
+        w.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    R::free_orphans();
+    return static_cast<double>(threads * per_thread) / seconds / 1e6;
+}
+
+// Two threads push and pop while a third sits in a read-side section for `stall`. Returns the
+// largest number of retired-but-unfreed nodes seen.
+template<class R>
+long long peak_pending_with_stalled_reader(std::chrono::milliseconds stall) {
+    LockFreeStack<long long, R> stack;
+    for (int i = 0; i < 1000; ++i) {
+        stack.push(i);
+    }
+    std::atomic<bool> stop{false};
+    std::thread reader([&] { stack.stall_reading(stall); });
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 2; ++t) {
+        workers.emplace_back([&] {
+            long long v, i = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                stack.push(i++);
+                stack.pop(v);
+            }
+        });
+    }
+    long long peak = 0;
+    auto end = std::chrono::steady_clock::now() + stall;
+    while (std::chrono::steady_clock::now() < end) {
+        peak = std::max(peak, R::pending());
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    reader.join();
+    stop = true;
+    for (std::thread& w : workers) {
+        w.join();
+    }
+    R::free_orphans();
+    return peak;
+}
+
+int main(int argc, char* argv[]) {
+    long long per_thread = argc > 1 ? std::stoll(argv[1]) : 1000000;
+    std::chrono::milliseconds stall(argc > 2 ? std::stoi(argv[2]) : 300);
+
+    std::cout << "Benchmark: " << per_thread << " push+pop per thread, " << std::thread::hardware_concurrency()
+              << " hardware threads. Million pops/s" << std::endl;
+    std::cout << "threads  hazard pointers       EBR" << std::endl;
+    for (int threads : {1, 2, 4, 8}) {
+        char line[96];
+        std::snprintf(line, sizeof(line), "%7d %16.2f %9.2f", threads, throughput<HazardPointers>(threads, per_thread),
+                      throughput<EpochReclamation>(threads, per_thread));
+        std::cout << line << std::endl;
+    }
+
+    std::cout << "One reader stalled for " << stall.count() << " ms, two threads popping:" << std::endl;
+    long long hp = peak_pending_with_stalled_reader<HazardPointers>(stall);
+    long long ebr = peak_pending_with_stalled_reader<EpochReclamation>(stall);
+    const long long node_bytes = 16;
+    std::cout << "  hazard pointers: at most " << hp << " nodes (" << hp * node_bytes / 1024
+              << " KiB) waiting to be freed" << std::endl;
+    std::cout << "  EBR:             at most " << ebr << " nodes (" << ebr * node_bytes / 1024
+              << " KiB) waiting to be freed" << std::endl;
+    return 0;
+}
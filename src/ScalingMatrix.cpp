@@ -0,0 +1,430 @@
+// A producer/consumer scaling benchmark matrix.
+// ConsumerProducer.cpp runs 1 producer and 2 consumers with a 1-second sleep between items,
+// which measures the sleep. This sweeps the things that actually decide queue performance:
+//   - queue implementation:
+//       mutex_cv    ConsumerProducer.cpp's std::queue + mutex + condition variable, one item per pop.
+//       batch_drain The same, but a consumer takes everything queued under one lock.
+//       spsc_ring   A lock-free single-producer/single-consumer ring (1:1 runs only).
+//       mpmc_ring   Dmitry Vyukov's bounded lock-free multi-producer/multi-consumer ring.
+//   - producer count, consumer count and message size.
+// For every combination it reports throughput, p50/p99/p999 enqueue-to-dequeue latency and the
+// voluntary/involuntary context switches the run caused (getrusage), as CSV or, with --json, JSON.
+// mutex_cv, batch_drain and spsc_ring are compact copies so this file stays self-contained;
+// SpscRing.cpp and BlockingQueue.cpp have the documented versions. mpmc_ring is new here and
+// is not LockFreeQueue.cpp's Michael-Scott queue: that one allocates a node per item and frees
+// it through hazard pointers, so the column would mostly measure the allocator.
+//
+// Usage: ScalingMatrix [--json] [messages per run]
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <sys/resource.h>
+
+using Clock = std::chrono::steady_clock;
+
+long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// A message of Size bytes in total: the enqueue timestamp plus payload.
+template<size_t Size>
+struct Message {
+    long long enqueued_ns = 0;
+    char payload[Size - sizeof(long long)];
+};
+
+// --- Queues. All of them: push() blocks or spins until there's room, pop() returns false once
+// the queue is closed and empty. ---
+
+template<class T>
+class MutexQueue {
+public:
+    // Bounded like the rings, so every queue is compared at the same maximum backlog.
+    explicit MutexQueue(size_t capacity) : capacity(capacity) {}
+
+    void push(const T& item) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            not_full.wait(lock, [this] { return items.size() < capacity; });
+            items.push_back(item);
+        }
+        cv.notify_one();
+    }
+
+    bool pop(T& out) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [this] { return !items.empty() || closed; });
+            if (items.empty()) {
+                return false;
+            }
+            out = items.front();
+            items.pop_front();
+        }
+        not_full.notify_one();
+        return true;
+    }
+
+    // Takes everything that's queued. Returns false once closed and empty.
+    bool pop_all(std::deque<T>& out) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [this] { return !items.empty() || closed; });
+            if (items.empty()) {
+                return false;
+            }
+            out.swap(items);
+        }
+        not_full.notify_all();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            closed = true;
+        }
+        cv.notify_all();
+    }
+
+private:
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::condition_variable not_full;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed = false;
+};
+
+template<class T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) : buffer(capacity), mask(capacity - 1) {}
+
+    void push(const T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        while (t - cached_head == buffer.size()) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head == buffer.size()) {
+                std::this_thread::yield();
+            }
+        }
+        buffer[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+    }
+
+    bool pop(T& out) {
+        size_t h = head.load(std::memory_order_relaxed);
+        while (h == cached_tail) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail) {
+                if (closed.load(std::memory_order_acquire)) {
+                    cached_tail = tail.load(std::memory_order_acquire);
+                    if (h == cached_tail) {
+                        return false;
+                    }
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+        out = buffer[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    void close() { closed.store(true, std::memory_order_release); }
+
+private:
+    std::vector<T> buffer;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0};
+    size_t cached_tail = 0;
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t cached_head = 0;
+    alignas(64) std::atomic<bool> closed{false};
+};
+
+// Dmitry Vyukov's bounded MPMC ring. Every cell carries a sequence number saying whose turn it is: a producer may fill cell i when
+// seq == position, a consumer may empty it when seq == position + 1. Claiming a position is one
+// CAS on the shared enqueue/dequeue counter.
+template<class T>
+class MpmcRing {
+public:
+    explicit MpmcRing(size_t capacity) : cells(capacity), mask(capacity - 1) {
+        for (size_t i = 0; i < capacity; ++i) {
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool try_push(const T& item) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = item;
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // Full.
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T& out) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    out = cell.data;
+                    cell.seq.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // Empty.
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void push(const T& item) {
+        while (!try_push(item)) {
+            std::this_thread::yield();
+        }
+    }
+
+    bool pop(T& out) {
+        while (!try_pop(out)) {
+            if (closed.load(std::memory_order_acquire)) {
+                return try_pop(out);
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    void close() { closed.store(true, std::memory_order_release); }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+    std::vector<Cell> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> dequeue_pos{0};
+    alignas(64) std::atomic<bool> closed{false};
+};
+
+// --- One run ---
+
+enum class QueueKind { mutex_cv, batch_drain, spsc_ring, mpmc_ring };
+
+const char* name_of(QueueKind kind) {
+    switch (kind) {
+    case QueueKind::mutex_cv: return "mutex_cv";
+    case QueueKind::batch_drain: return "batch_drain";
+    case QueueKind::spsc_ring: return "spsc_ring";
+    case QueueKind::mpmc_ring: return "mpmc_ring";
+    }
+    return "?";
+}
+
+struct Result {
+    QueueKind queue;
+    int producers, consumers;
+    size_t msg_bytes;
+    long long messages;
+    double msgs_per_sec;
+    long long p50_ns, p99_ns, p999_ns;
+    long long voluntary_switches, involuntary_switches;
+};
+
+const size_t kCapacity = 4096;
+
+template<class Msg, class Queue, class ConsumeLoop>
+Result run_one(QueueKind kind, int producers, int consumers, long long n, ConsumeLoop consume_loop) {
+    Queue q(kCapacity);
+    std::vector<std::vector<long long>> latencies(consumers);
+    for (auto& l : latencies) {
+        l.reserve(static_cast<size_t>(n / consumers * 2));
+    }
+
+    rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    auto start = Clock::now();
+
+    std::vector<std::thread> consumer_threads;
+    for (int c = 0; c < consumers; ++c) {
+        consumer_threads.emplace_back([&, c] { consume_loop(q, latencies[c]); });
+    }
+    std::vector<std::thread> producer_threads;
+    for (int p = 0; p < producers; ++p) {
+        producer_threads.emplace_back([&, p] {
+            Msg m;
+            std::memset(m.payload, 'x', sizeof(m.payload));
+            for (long long i = p; i < n; i += producers) {
+                m.enqueued_ns = now_ns();
+                q.push(m);
+            }
+        });
+    }
+    for (std::thread& t : producer_threads) {
+        t.join();
+    }
+    q.close();
+    for (std::thread& t : consumer_threads) {
+        t.join();
+    }
+
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    getrusage(RUSAGE_SELF, &after);
+
+    std::vector<long long> all;
+    for (auto& l : latencies) {
+        all.insert(all.end(), l.begin(), l.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto pct = [&](double p) { return all.empty() ? 0 : all[static_cast<size_t>(p * static_cast<double>(all.size() - 1))]; };
+
+    Result r;
+    r.queue = kind;
+    r.producers = producers;
+    r.consumers = consumers;
+    r.msg_bytes = sizeof(Msg);
+    r.messages = static_cast<long long>(all.size());
+    r.msgs_per_sec = static_cast<double>(all.size()) / seconds;
+    r.p50_ns = pct(0.50);
+    r.p99_ns = pct(0.99);
+    r.p999_ns = pct(0.999);
+    r.voluntary_switches = after.ru_nvcsw - before.ru_nvcsw;
+    r.involuntary_switches = after.ru_nivcsw - before.ru_nivcsw;
+    return r;
+}
+
+template<class Msg>
+void run_queue(QueueKind kind, int producers, int consumers, long long n, std::vector<Result>& results) {
+    auto one_at_a_time = [](auto& q, std::vector<long long>& lat) {
+        Msg m;
+        while (q.pop(m)) {
+            lat.push_back(now_ns() - m.enqueued_ns);
+        }
+    };
+    switch (kind) {
+    case QueueKind::mutex_cv:
+        results.push_back(run_one<Msg, MutexQueue<Msg>>(kind, producers, consumers, n, one_at_a_time));
+        break;
+    case QueueKind::batch_drain:
+        results.push_back(run_one<Msg, MutexQueue<Msg>>(kind, producers, consumers, n,
+            [](MutexQueue<Msg>& q, std::vector<long long>& lat) {
+                std::deque<Msg> batch;
+                while (q.pop_all(batch)) {
+                    long long now = now_ns();
+                    for (const Msg& m : batch) {
+                        lat.push_back(now - m.enqueued_ns);
+                    }
+                    batch.clear();
+                }
+            }));
+        break;
+    case QueueKind::spsc_ring:
+        results.push_back(run_one<Msg, SpscRing<Msg>>(kind, producers, consumers, n, one_at_a_time));
+        break;
+    case QueueKind::mpmc_ring:
+        results.push_back(run_one<Msg, MpmcRing<Msg>>(kind, producers, consumers, n, one_at_a_time));
+        break;
+    }
+}
+
+void run_size(size_t bytes, QueueKind kind, int producers, int consumers, long long n, std::vector<Result>& results) {
+    switch (bytes) {
+    case 16: run_queue<Message<16>>(kind, producers, consumers, n, results); break;
+    case 64: run_queue<Message<64>>(kind, producers, consumers, n, results); break;
+    case 256: run_queue<Message<256>>(kind, producers, consumers, n, results); break;
+    case 1024: run_queue<Message<1024>>(kind, producers, consumers, n, results); break;
+    }
+}
+
+// --- Output ---
+
+void print_csv(const std::vector<Result>& results) {
+    std::cout << "queue,producers,consumers,msg_bytes,messages,msgs_per_sec,p50_ns,p99_ns,p999_ns,"
+                 "voluntary_switches,involuntary_switches\n";
+    for (const Result& r : results) {
+        std::cout << name_of(r.queue) << ',' << r.producers << ',' << r.consumers << ',' << r.msg_bytes << ','
+                  << r.messages << ',' << static_cast<long long>(r.msgs_per_sec) << ',' << r.p50_ns << ','
+                  << r.p99_ns << ',' << r.p999_ns << ',' << r.voluntary_switches << ','
+                  << r.involuntary_switches << '\n';
+    }
+}
+
+void print_json(const std::vector<Result>& results) {
+    std::cout << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        std::cout << "  {\"queue\": \"" << name_of(r.queue) << "\", \"producers\": " << r.producers
+                  << ", \"consumers\": " << r.consumers << ", \"msg_bytes\": " << r.msg_bytes
+                  << ", \"messages\": " << r.messages
+                  << ", \"msgs_per_sec\": " << static_cast<long long>(r.msgs_per_sec)
+                  << ", \"p50_ns\": " << r.p50_ns << ", \"p99_ns\": " << r.p99_ns << ", \"p999_ns\": " << r.p999_ns
+                  << ", \"voluntary_switches\": " << r.voluntary_switches
+                  << ", \"involuntary_switches\": " << r.involuntary_switches << "}"
+                  << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    std::cout << "]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    bool json = false;
+    long long n = 100000;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else {
+            n = std::stoll(argv[i]);
+        }
+    }
+
+    std::vector<Result> results;
+    for (QueueKind kind : {QueueKind::mutex_cv, QueueKind::batch_drain, QueueKind::spsc_ring, QueueKind::mpmc_ring}) {
+        for (int producers : {1, 2, 4}) {
+            for (int consumers : {1, 2, 4}) {
+                if (kind == QueueKind::spsc_ring && (producers != 1 || consumers != 1)) {
+                    continue; // Only correct with exactly one of each.
+                }
+                for (size_t bytes : {16, 64, 256, 1024}) {
+                    run_size(bytes, kind, producers, consumers, n, results);
+                    std::cerr << "." << std::flush; // Progress, kept out of the data on stdout.
+                }
+            }
+        }
+    }
+    std::cerr << std::endl;
+
+    if (json) {
+        print_json(results);
+    } else {
+        print_csv(results);
+    }
+    return 0;
+}
@@ -0,0 +1,438 @@
+// A cross-process queue in POSIX shared memory, with futex-based blocking.
+// ConsumerProducer.cpp's queue only works between threads of one process. When producer and
+// consumer run as separate processes for isolation, the usual answer is a pipe or a Unix-domain
+// socket: a system call and a kernel copy on each side, for every message. Here both processes
+// map the same shm_open() object, and the queue inside it is a lock-free single-producer/single-
+// consumer ring of fixed-size slots (the same idea as SpscRing.cpp):
+//   - Pushing or popping a message is a memcpy plus one atomic store. No system call.
+//   - A side only enters the kernel when it actually has to sleep. It then waits on a futex word in
+//     the shared mapping. We don't pass FUTEX_PRIVATE_FLAG, so the kernel matches waiters by the
+//     physical page and the futex works across processes.
+//   - The other side only issues FUTEX_WAKE if a waiter has announced itself (an "eventcount").
+//     While both sides are busy, no wake syscalls happen at all.
+//   - Crashed peers: each side records its pid in the header. A sleeping side wakes up
+//     periodically, checks whether the peer still exists, and reports peer_dead instead of
+//     hanging forever. The indices only move after a slot is fully written or fully read, so a
+//     crash never leaves a half-written message visible. A restarted peer can re-attach and carry on.
+//   - Nothing read from the mapping is trusted: attaching checks the object's size against the
+//     header, and pop() reports `corrupt` for a length no slot can hold instead of copying it.
+#include <iostream>
+#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <string>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <unistd.h>
+
+[[noreturn]] void throw_errno(const std::string& what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+// Sleeps while *word == expected, for at most timeout_ms. Spurious returns are fine: callers re-check.
+void futex_wait(std::atomic<uint32_t>* word, uint32_t expected, long timeout_ms) {
+    timespec ts{timeout_ms / 1000, (timeout_ms % 1000) * 1000000};
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+void futex_wake_all(std::atomic<uint32_t>* word) {
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+// A zombie (exited, not yet reaped by its parent) still answers kill(pid, 0), so look at its state too.
+bool process_alive(pid_t pid) {
+    if (pid <= 0 || (::kill(pid, 0) != 0 && errno != EPERM)) {
+        return false;
+    }
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    std::getline(stat, line);
+    size_t paren = line.rfind(')'); // The command name may itself contain spaces or parentheses.
+    return paren == std::string::npos || paren + 2 >= line.size() || line[paren + 2] != 'Z';
+}
+
+const uint32_t kMagic = 0x51554555; // "QUEU"
+const uint32_t kSlotSize = 256;
+const uint32_t kMaxMessage = kSlotSize - sizeof(uint32_t);
+
+// One side of the ring's state: an index plus the futex the *other* side sleeps on.
+struct alignas(64) RingSide {
+    std::atomic<uint64_t> index{0};    // head (consumer side) or tail (producer side).
+    std::atomic<uint32_t> event{0};    // Bumped to wake the other side.
+    std::atomic<uint32_t> waiters{0};  // The other side is (about to be) asleep on `event`.
+    std::atomic<int32_t> pid{0};
+};
+
+// Lives at the start of the shared mapping. Every field must be address-free, because each
+// process maps it at a different address: no pointers, only lock-free atomics.
+struct ShmHeader {
+    std::atomic<uint32_t> magic;
+    uint32_t slot_count;
+    RingSide consumer; // head; producer waits on consumer.event for free space.
+    RingSide producer; // tail; consumer waits on producer.event for data.
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared-memory atomics must be lock-free");
+
+class ShmQueue {
+public:
+    enum class Role { producer, consumer };
+    enum class Status { ok, peer_dead, corrupt };
+
+    // The creator sizes and initializes the object; the other side attaches to it by name.
+    ShmQueue(const std::string& name, Role role, bool create, uint32_t slot_count = 1024)
+        : name(name), role(role), owner(create) {
+        if (create && !is_power_of_two(slot_count)) {
+            throw std::invalid_argument("slot_count must be a power of two");
+        }
+        int fd = ::shm_open(name.c_str(), O_RDWR | (create ? O_CREAT | O_EXCL : 0), 0600);
+        if (fd < 0) {
+            throw_errno("shm_open " + name);
+        }
+        if (create) {
+            map_size = sizeof(ShmHeader) + size_t(slot_count) * kSlotSize;
+            if (::ftruncate(fd, static_cast<off_t>(map_size)) != 0) {
+                throw_errno("ftruncate " + name);
+            }
+        } else {
+            off_t size = ::lseek(fd, 0, SEEK_END);
+            if (size < static_cast<off_t>(sizeof(ShmHeader))) {
+                ::close(fd);
+                throw std::runtime_error("too small to be a queue: " + name);
+            }
+            map_size = static_cast<size_t>(size);
+        }
+        void* p = ::mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            throw_errno("mmap " + name);
+        }
+        header = static_cast<ShmHeader*>(p);
+        slots = static_cast<char*>(p) + sizeof(ShmHeader);
+
+        if (create) {
+            new (header) ShmHeader();
+            header->slot_count = slot_count;
+            header->magic.store(kMagic, std::memory_order_release); // Publishes the initialized header.
+        } else {
+            // Whoever created the object may be buggy or hostile: check the header against the
+            // mapping before any index is turned into an address.
+            const char* problem = nullptr;
+            if (header->magic.load(std::memory_order_acquire) != kMagic) {
+                problem = "not an initialized queue: ";
+            } else if (!is_power_of_two(header->slot_count)) {
+                problem = "bad slot count in queue: ";
+            } else if (map_size < sizeof(ShmHeader) + size_t(header->slot_count) * kSlotSize) {
+                problem = "queue smaller than its slot count: ";
+            }
+            if (problem) {
+                ::munmap(p, map_size);
+                throw std::runtime_error(problem + name);
+            }
+        }
+        // Read once: the peer can't grow the ring under us after we've checked it.
+        num_slots = header->slot_count;
+        mask = num_slots - 1;
+        self().pid.store(::getpid());
+        cached_head = header->consumer.index.load();
+        cached_tail = header->producer.index.load();
+    }
+
+    ~ShmQueue() {
+        ::munmap(header, map_size);
+        if (owner) {
+            ::shm_unlink(name.c_str());
+        }
+    }
+
+    ShmQueue(const ShmQueue&) = delete;
+    ShmQueue& operator=(const ShmQueue&) = delete;
+
+    // Blocks while the ring is full. Producer side only.
+    Status push(const void* data, uint32_t length) {
+        if (length > kMaxMessage) {
+            throw std::invalid_argument("message larger than a slot");
+        }
+        uint64_t tail = header->producer.index.load(std::memory_order_relaxed);
+        if (tail - cached_head == num_slots) {
+            Status s = wait_until(header->consumer, [&] {
+                cached_head = header->consumer.index.load(std::memory_order_acquire);
+                return tail - cached_head < num_slots;
+            });
+            if (s != Status::ok) {
+                return s;
+            }
+        }
+        char* slot = slots + (tail & mask) * kSlotSize;
+        std::memcpy(slot, &length, sizeof(length));
+        std::memcpy(slot + sizeof(length), data, length);
+        header->producer.index.store(tail + 1, std::memory_order_release);
+        wake(header->producer);
+        return Status::ok;
+    }
+
+    // Blocks while the ring is empty. Consumer side only. `out` must hold kMaxMessage bytes.
+    // Returns corrupt, without consuming the slot, if the peer wrote a length that doesn't fit.
+    Status pop(void* out, uint32_t& length) {
+        uint64_t head = header->consumer.index.load(std::memory_order_relaxed);
+        if (head == cached_tail) {
+            Status s = wait_until(header->producer, [&] {
+                cached_tail = header->producer.index.load(std::memory_order_acquire);
+                return head != cached_tail;
+            });
+            if (s != Status::ok) {
+                return s;
+            }
+        }
+        const char* slot = slots + (head & mask) * kSlotSize;
+        std::memcpy(&length, slot, sizeof(length));
+        if (length > kMaxMessage) {
+            length = 0;
+            return Status::corrupt;
+        }
+        std::memcpy(out, slot + sizeof(length), length);
+        header->consumer.index.store(head + 1, std::memory_order_release);
+        wake(header->consumer);
+        return Status::ok;
+    }
+
+private:
+    static bool is_power_of_two(uint32_t n) { return n != 0 && (n & (n - 1)) == 0; }
+
+    RingSide& self() { return role == Role::producer ? header->producer : header->consumer; }
+
+    // Waits for `ready()`, sleeping on the peer's event futex. Checks every 100 ms that the peer lives.
+    template<class Ready>
+    Status wait_until(RingSide& peer, Ready ready) {
+        for (int spin = 0; spin < 64; ++spin) {
+            if (ready()) {
+                return Status::ok;
+            }
+        }
+        while (true) {
+            uint32_t key = peer.event.load();
+            peer.waiters.fetch_add(1); // seq_cst: pairs with the fence in wake().
+            if (ready()) {
+                peer.waiters.fetch_sub(1);
+                return Status::ok;
+            }
+            futex_wait(&peer.event, key, 100);
+            peer.waiters.fetch_sub(1);
+            if (ready()) {
+                return Status::ok;
+            }
+            int32_t peer_pid = peer.pid.load();
+            if (peer_pid != 0 && !process_alive(peer_pid)) {
+                return Status::peer_dead;
+            }
+        }
+    }
+
+    // Called after publishing an index. Either we see the waiter, or the waiter sees our index.
+    void wake(RingSide& side) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (side.waiters.load(std::memory_order_relaxed) > 0) {
+            side.event.fetch_add(1);
+            futex_wake_all(&side.event);
+        }
+    }
+
+    std::string name;
+    Role role;
+    bool owner;
+    size_t map_size = 0;
+    ShmHeader* header = nullptr;
+    char* slots = nullptr;
+    uint32_t num_slots = 0;
+    uint64_t mask = 0;
+    uint64_t cached_head = 0; // Producer's view of the consumer.
+    uint64_t cached_tail = 0; // Consumer's view of the producer.
+};
+
+// --- Example: the producer notices that its consumer crashed ---
+
+void example() {
+    std::string name = "/cpp_multithread_example_" + std::to_string(::getpid());
+    ShmQueue q(name, ShmQueue::Role::producer, true, 8);
+
+    pid_t child = ::fork();
+    if (child == 0) {
+        ShmQueue c(name, ShmQueue::Role::consumer, false);
+        char buf[kMaxMessage];
+        uint32_t len;
+        c.pop(buf, len);
+        std::cout << "Consumer: Processed '" << std::string(buf, len) << "', now crashing." << std::endl;
+        ::_exit(1); // No destructors, no goodbye: like a crash.
+    }
+
+    for (int i = 0; ; ++i) {
+        std::string data = "Data packet " + std::to_string(i);
+        if (q.push(data.data(), static_cast<uint32_t>(data.size())) == ShmQueue::Status::peer_dead) {
+            std::cout << "Producer: Consumer died; " << i << " packets pushed, ring full." << std::endl;
+            break;
+        }
+    }
+    ::waitpid(child, nullptr, 0);
+
+    // Attaching checks the object before trusting its header.
+    std::string bogus = name + "_bogus";
+    int fd = ::shm_open(bogus.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0 && ::ftruncate(fd, 16) == 0) {
+        try {
+            ShmQueue bad(bogus, ShmQueue::Role::consumer, false);
+        } catch (const std::runtime_error& e) {
+            std::cout << "Rejected: " << e.what() << std::endl;
+        }
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        ::shm_unlink(bogus.c_str());
+    }
+}
+
+// --- Benchmark: shared-memory ring vs a Unix-domain socket between two processes ---
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void read_exact(int fd, void* buf, size_t n) {
+    char* p = static_cast<char*>(buf);
+    while (n > 0) {
+        ssize_t got = ::read(fd, p, n);
+        if (got <= 0) {
+            throw_errno("read");
+        }
+        p += got;
+        n -= static_cast<size_t>(got);
+    }
+}
+
+void write_exact(int fd, const void* buf, size_t n) {
+    const char* p = static_cast<const char*>(buf);
+    while (n > 0) {
+        ssize_t put = ::write(fd, p, n);
+        if (put <= 0) {
+            throw_errno("write");
+        }
+        p += put;
+        n -= static_cast<size_t>(put);
+    }
+}
+
+void report(const std::string& name, double throughput_s, long long n, std::vector<double>& rtts) {
+    std::sort(rtts.begin(), rtts.end());
+    std::cout << name << ": throughput " << static_cast<long long>(n / throughput_s)
+              << " msgs/s, round trip p50 " << rtts[rtts.size() / 2] << " us, p99 "
+              << rtts[rtts.size() * 99 / 100] << " us" << std::endl;
+}
+
+const uint32_t kMessage = 64;
+
+void bench_shm(long long n, long long round_trips) {
+    std::string base = "/cpp_multithread_bench_" + std::to_string(::getpid());
+    ShmQueue to_child(base + "_a", ShmQueue::Role::producer, true);
+    ShmQueue from_child(base + "_b", ShmQueue::Role::consumer, true);
+
+    pid_t child = ::fork();
+    if (child == 0) {
+        ShmQueue in(base + "_a", ShmQueue::Role::consumer, false);
+        ShmQueue out(base + "_b", ShmQueue::Role::producer, false);
+        char buf[kMaxMessage];
+        uint32_t len;
+        for (long long i = 0; i < n; ++i) {
+            in.pop(buf, len);
+        }
+        out.push(buf, len); // "Got everything."
+        for (long long i = 0; i < round_trips; ++i) {
+            in.pop(buf, len);
+            out.push(buf, len); // Echo.
+        }
+        ::_exit(0);
+    }
+
+    char msg[kMessage] = {};
+    char reply[kMaxMessage];
+    uint32_t len;
+    auto start = std::chrono::steady_clock::now();
+    for (long long i = 0; i < n; ++i) {
+        to_child.push(msg, kMessage);
+    }
+    from_child.pop(reply, len);
+    double throughput_s = seconds_since(start);
+
+    std::vector<double> rtts;
+    for (long long i = 0; i < round_trips; ++i) {
+        auto t = std::chrono::steady_clock::now();
+        to_child.push(msg, kMessage);
+        from_child.pop(reply, len);
+        rtts.push_back(seconds_since(t) * 1e6);
+    }
+    ::waitpid(child, nullptr, 0);
+    report("shared-memory ring ", throughput_s, n, rtts);
+}
+
+void bench_socket(long long n, long long round_trips) {
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        throw_errno("socketpair");
+    }
+    pid_t child = ::fork();
+    if (child == 0) {
+        ::close(fds[0]);
+        char buf[kMessage];
+        for (long long i = 0; i < n; ++i) {
+            read_exact(fds[1], buf, kMessage);
+        }
+        write_exact(fds[1], buf, kMessage);
+        for (long long i = 0; i < round_trips; ++i) {
+            read_exact(fds[1], buf, kMessage);
+            write_exact(fds[1], buf, kMessage);
+        }
+        ::_exit(0);
+    }
+    ::close(fds[1]);
+
+    char msg[kMessage] = {};
+    auto start = std::chrono::steady_clock::now();
+    for (long long i = 0; i < n; ++i) {
+        write_exact(fds[0], msg, kMessage); // One message per write(), like one push per message.
+    }
+    read_exact(fds[0], msg, kMessage);
+    double throughput_s = seconds_since(start);
+
+    std::vector<double> rtts;
+    for (long long i = 0; i < round_trips; ++i) {
+        auto t = std::chrono::steady_clock::now();
+        write_exact(fds[0], msg, kMessage);
+        read_exact(fds[0], msg, kMessage);
+        rtts.push_back(seconds_since(t) * 1e6);
+    }
+    ::waitpid(child, nullptr, 0);
+    ::close(fds[0]);
+    report("Unix-domain socket ", throughput_s, n, rtts);
+}
+
+int main(int argc, char* argv[]) {
+    example();
+
+    long long n = argc > 1 ? std::stoll(argv[1]) : 2000000;
+    long long round_trips = 20000;
+    std::cout << "\nBenchmark: parent -> child process, " << n << " messages of " << kMessage
+              << " bytes, then " << round_trips << " ping-pongs" << std::endl;
+    bench_shm(n, round_trips);
+    bench_socket(n, round_trips);
+    return 0;
+}
@@ -0,0 +1,128 @@
+// A family of spinlocks for very short critical sections: TTAS with backoff, ticket, MCS and CLH.
+// Mutex.cpp and LockGuard.cpp protect one counter++ with std::mutex. When the lock is taken,
+// std::mutex spins only briefly and then sleeps in the kernel (futex), and the unlock has to wake
+// it again: two system calls to protect a few nanoseconds of work. A spinlock just waits in user
+// space. How it waits decides how it behaves under contention:
+//   - TTASLock (test-and-test-and-set): waiters spin on a plain load, which hits their own cached
+//     copy of the line, and only try the atomic exchange once the lock looks free. After a failed
+//     attempt they back off exponentially, so they don't all stampede at once. Not fair.
+//   - TicketLock: take a number, wait until it's served. Strictly FIFO, but every waiter spins on
+//     the same `now_serving` line, so every unlock invalidates all of them.
+//   - MCSLock: waiters form a linked queue and each spins on a flag in its *own* node. The unlock
+//     touches only the next waiter's line. FIFO and scalable.
+//   - CLHLock: also a queue, but each waiter spins on its predecessor's node. Unlocking is a single
+//     store; the price is that nodes move between threads.
+// TTAS, ticket and MCS satisfy Lockable (lock / try_lock / unlock), so std::lock_guard and
+// std::unique_lock work with them unchanged. CLH is only BasicLockable (no try_lock; see
+// locks/SpinLocks.h for why), which is enough for std::lock_guard and a blocking std::unique_lock. Spinning is bounded: after a while a waiter also yields its CPU, so a
+// preempted lock holder can still run when threads outnumber cores. Even so, the FIFO locks
+// (ticket, MCS, CLH) suffer badly in that case: the next thread in line may not be running, and
+// nobody else is allowed to go ahead of it. Prefer TTAS or std::mutex when that can happen.
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include "locks/SpinLocks.h"
+
+// --- Benchmark: each lock vs std::mutex, over contention and critical-section length ---
+
+// The protected work: `work` rounds of an LCG on shared state, then the counter++.
+long long counter = 0;
+unsigned long long shared_state = 1;
+
+inline void critical_section(int work) {
+    for (int i = 0; i < work; ++i) {
+        shared_state = shared_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    counter++;
+}
+
+struct Result {
+    double ns_per_op;
+    double fairness; // min/max of per-thread ops.
+    bool correct;
+};
+
+template<class Lock>
+Result run(int threads, int work, std::chrono::milliseconds duration) {
+    Lock lock;
+    counter = 0;
+    std::vector<long long> ops(threads, 0);
+    std::atomic<bool> go{false}, stop{false};
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            long long n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                std::lock_guard<Lock> guard(lock);
+                critical_section(work);
+                ++n;
+            }
+            ops[t] = n;
+        });
+    }
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (std::thread& w : workers) {
+        w.join();
+    }
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+
+    long long total = 0;
+    for (long long n : ops) {
+        total += n;
+    }
+    auto [lo, hi] = std::minmax_element(ops.begin(), ops.end());
+    return {ns / static_cast<double>(total), *hi > 0 ? static_cast<double>(*lo) / static_cast<double>(*hi) : 0,
+            counter == total};
+}
+
+template<class Lock>
+void report(const char* name, int threads, int work, std::chrono::milliseconds duration) {
+    Result r = run<Lock>(threads, work, duration);
+    char line[128];
+    std::snprintf(line, sizeof(line), "  %-10s %8.1f ns/op   fairness %.2f   %s", name, r.ns_per_op, r.fairness,
+                  r.correct ? "ok" : "WRONG COUNT");
+    std::cout << line << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::chrono::milliseconds duration(argc > 1 ? std::stoi(argv[1]) : 150);
+
+    // Quick check that the locks work through std::unique_lock and try_lock too.
+    {
+        MCSLock mcs;
+        CLHLock clh;
+        std::unique_lock<CLHLock> a(clh);
+        std::unique_lock<MCSLock> b(mcs, std::try_to_lock);
+        std::unique_lock<MCSLock> c(mcs, std::try_to_lock);
+        std::cout << "unique_lock/try_to_lock: " << (a.owns_lock() && b.owns_lock() && !c.owns_lock() ? "ok" : "FAILED")
+                  << std::endl;
+    }
+
+    std::cout << "Benchmark: " << duration.count() << " ms per run, " << std::thread::hardware_concurrency()
+              << " hardware threads" << std::endl;
+    for (int work : {0, 20, 200}) {
+        for (int threads : {1, 2, 4, 8}) {
+            std::cout << threads << " threads, critical section = counter++ after " << work << " LCG steps" << std::endl;
+            report<std::mutex>("std::mutex", threads, work, duration);
+            report<TTASLock>("TTAS", threads, work, duration);
+            report<TicketLock>("ticket", threads, work, duration);
+            report<MCSLock>("MCS", threads, work, duration);
+            report<CLHLock>("CLH", threads, work, duration);
+        }
+    }
+    return 0;
+}
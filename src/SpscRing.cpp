@@ -0,0 +1,270 @@
+// A bounded, wait-free single-producer/single-consumer (SPSC) ring buffer.
+// ConsumerProducer.cpp takes a mutex and notifies a condition variable for every item.
+// With exactly one producer and one consumer we need neither:
+//   - The producer is the only thread that writes `tail`, the consumer the only one that writes `head`.
+//     Each side publishes its index with a release store and reads the other's with an acquire load,
+//     which is enough to make the slot contents visible. No read-modify-write, no CAS, no lock.
+//   - `head` and `tail` live on separate cache lines, so the two threads don't fight over one line.
+//   - Each side keeps a private cached copy of the *other* side's index and only re-reads the shared
+//     one when the cache says the ring looks full (producer) or empty (consumer).
+//     In steady state that removes most of the cross-core traffic.
+// Every push and pop finishes in a bounded number of steps: they just return false when the ring
+// is full/empty, and the caller decides whether to spin, yield or do something else.
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <string>
+
+template<class T>
+class SpscRing {
+public:
+    // Capacity is rounded up to a power of two so that index wrapping is a mask, not a modulo.
+    explicit SpscRing(size_t min_capacity) {
+        size_t capacity = 1;
+        while (capacity < min_capacity) {
+            capacity <<= 1;
+        }
+        mask = capacity - 1;
+        buffer.resize(capacity);
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    // Producer side.
+    bool try_push(T item) {
+        size_t t = tail.load(std::memory_order_relaxed); // Only we write tail.
+        if (t - cached_head == capacity()) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head == capacity()) {
+                return false; // Really full.
+            }
+        }
+        buffer[t & mask] = std::move(item);
+        tail.store(t + 1, std::memory_order_release); // Publishes the slot to the consumer.
+        return true;
+    }
+
+    // Pushes as many of items[0..n) as fit, with one index publication for the whole batch.
+    size_t try_push_batch(const T* items, size_t n) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t free_slots = capacity() - (t - cached_head);
+        if (free_slots < n) {
+            cached_head = head.load(std::memory_order_acquire);
+            free_slots = capacity() - (t - cached_head);
+        }
+        size_t count = std::min(n, free_slots);
+        for (size_t i = 0; i < count; ++i) {
+            buffer[(t + i) & mask] = items[i];
+        }
+        if (count > 0) {
+            tail.store(t + count, std::memory_order_release);
+        }
+        return count;
+    }
+
+    // Consumer side.
+    bool try_pop(T& out) {
+        size_t h = head.load(std::memory_order_relaxed); // Only we write head.
+        if (h == cached_tail) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail) {
+                return false; // Really empty.
+            }
+        }
+        out = std::move(buffer[h & mask]);
+        head.store(h + 1, std::memory_order_release); // Hands the slot back to the producer.
+        return true;
+    }
+
+    // Pops up to max items into out[0..max), with one index publication for the whole batch.
+    size_t try_pop_batch(T* out, size_t max) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t available = cached_tail - h;
+        if (available < max) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            available = cached_tail - h;
+        }
+        size_t count = std::min(max, available);
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = std::move(buffer[(h + i) & mask]);
+        }
+        if (count > 0) {
+            head.store(h + count, std::memory_order_release);
+        }
+        return count;
+    }
+
+private:
+    // Consumer-owned line: the read index and the consumer's view of the write index.
+    alignas(64) std::atomic<size_t> head{0};
+    size_t cached_tail = 0;
+
+    // Producer-owned line: the write index and the producer's view of the read index.
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t cached_head = 0;
+
+    // Read-only after construction, so it can share a line with nothing in particular.
+    alignas(64) size_t mask;
+    std::vector<T> buffer;
+};
+
+// --- Example: ConsumerProducer.cpp with the ring instead of queue + mutex + cv ---
+
+void example() {
+    SpscRing<std::string> ring(4);
+    const int kPackets = 5;
+
+    std::thread prod([&ring] {
+        for (int i = 0; i < kPackets; ++i) {
+            std::string data = "Data packet " + std::to_string(i);
+            // The ring is bounded: if it's full, back off and let the consumer run.
+            while (!ring.try_push(data)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    std::thread cons([&ring] {
+        // With a single consumer there is no "finished" flag to coordinate:
+        // we know exactly how many packets to expect.
+        for (int received = 0; received < kPackets; ) {
+            std::string data;
+            if (ring.try_pop(data)) {
+                std::cout << "Consumer: Processed '" << data << "'" << std::endl;
+                ++received;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    prod.join();
+    cons.join();
+}
+
+// --- Benchmark: messages/s and enqueue-to-dequeue latency ---
+
+struct Message {
+    long long seq = 0;
+    long long sent_ns = 0;
+};
+
+long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Result {
+    double msgs_per_sec;
+    std::vector<long long> latencies;
+    bool ok;
+};
+
+// The design from ConsumerProducer.cpp: one lock and one notify per item.
+Result bench_mutex_cv(long long n) {
+    std::queue<Message> q;
+    std::mutex mtx;
+    std::condition_variable cv;
+    Result r{0, {}, true};
+    r.latencies.reserve(n);
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread prod([&] {
+        for (long long i = 0; i < n; ++i) {
+            {
+                std::lock_guard<std::mutex> guard(mtx);
+                q.push({i, now_ns()});
+            }
+            cv.notify_one();
+        }
+    });
+    std::thread cons([&] {
+        for (long long expected = 0; expected < n; ++expected) {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&q] { return !q.empty(); });
+            Message m = q.front();
+            q.pop();
+            lock.unlock();
+            r.latencies.push_back(now_ns() - m.sent_ns);
+            r.ok = r.ok && m.seq == expected;
+        }
+    });
+    prod.join();
+    cons.join();
+    r.msgs_per_sec = n / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return r;
+}
+
+Result bench_spsc(long long n, size_t batch) {
+    SpscRing<Message> ring(1024);
+    Result r{0, {}, true};
+    r.latencies.reserve(n);
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread prod([&] {
+        std::vector<Message> pending(batch);
+        for (long long i = 0; i < n; ) {
+            size_t count = static_cast<size_t>(std::min<long long>(batch, n - i));
+            for (size_t k = 0; k < count; ++k) {
+                pending[k] = {i + static_cast<long long>(k), now_ns()};
+            }
+            size_t pushed = 0;
+            while (pushed < count) {
+                size_t done = batch == 1
+                    ? (ring.try_push(pending[0]) ? 1 : 0)
+                    : ring.try_push_batch(pending.data() + pushed, count - pushed);
+                pushed += done;
+                if (done == 0) {
+                    std::this_thread::yield();
+                }
+            }
+            i += count;
+        }
+    });
+    std::thread cons([&] {
+        std::vector<Message> got(batch);
+        for (long long expected = 0; expected < n; ) {
+            size_t count = batch == 1
+                ? (ring.try_pop(got[0]) ? 1 : 0)
+                : ring.try_pop_batch(got.data(), batch);
+            if (count == 0) {
+                std::this_thread::yield();
+                continue;
+            }
+            long long t = now_ns();
+            for (size_t k = 0; k < count; ++k, ++expected) {
+                r.latencies.push_back(t - got[k].sent_ns);
+                r.ok = r.ok && got[k].seq == expected;
+            }
+        }
+    });
+    prod.join();
+    cons.join();
+    r.msgs_per_sec = n / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return r;
+}
+
+void report(const std::string& name, Result r) {
+    std::sort(r.latencies.begin(), r.latencies.end());
+    auto pct = [&r](double p) { return r.latencies[static_cast<size_t>(p * (r.latencies.size() - 1))]; };
+    std::cout << name << ": " << static_cast<long long>(r.msgs_per_sec) << " msgs/s, latency p50 "
+              << pct(0.50) << " ns, p99 " << pct(0.99) << " ns"
+              << (r.ok ? "" : "  (ORDER/LOSS ERROR)") << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    example();
+
+    long long n = argc > 1 ? std::stoll(argv[1]) : 2000000;
+    std::cout << "\nBenchmark: 1 producer -> 1 consumer, " << n << " messages" << std::endl;
+    report("std::queue + mutex + cv ", bench_mutex_cv(n));
+    report("SPSC ring, single       ", bench_spsc(n, 1));
+    report("SPSC ring, batch of 32  ", bench_spsc(n, 32));
+    return 0;
+}
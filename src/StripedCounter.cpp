@@ -0,0 +1,183 @@
+// A striped counter: a drop-in for Atomic.cpp's atomic_counter that scales with the thread count.
+// In Atomic.cpp every thread does atomic_counter++ on the same std::atomic<long long>. Each
+// increment needs the cache line in exclusive state, so with several cores the line bounces
+// between them and every ++ waits for it: more threads, *less* throughput.
+// StripedCounter gives every thread its own slot instead:
+//   - Slots are padded to a cache line each, so two threads never write the same line.
+//   - Live threads get distinct slot indices (the same index for every StripedCounter). A slot
+//     has one writer, so add() is a plain relaxed load + store: no lock prefix, no CAS.
+//     Slots are per-thread rather than per-CPU for exactly that reason: a thread can migrate
+//     between CPUs mid-update, and then a per-CPU slot would need an atomic read-modify-write.
+//   - read() sums every slot. Slots only ever grow, so while add(1)s keep running the sum is a
+//     value the counter actually had at some point during the read; once the writers are done
+//     it's the exact total.
+//   - read_approx() is one load. Each thread pushes its slot into a shared total once it's
+//     `batch` ahead of what it last pushed, so the shared total lags by under threads * batch.
+//   - If more threads are alive than there are slots, the extra ones share one overflow slot
+//     and update it with fetch_add: slower, but never wrong.
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// Hands out small per-thread indices and takes them back when threads exit.
+class ThreadIndex {
+public:
+    static const int kMaxThreads = 256;
+    static const int kNone = -1;
+
+    // This thread's index, or kNone if all are taken.
+    static int get() {
+        thread_local Holder holder;
+        return holder.index;
+    }
+
+private:
+    struct Holder {
+        int index = kNone;
+        Holder() {
+            for (int i = 0; i < kMaxThreads; ++i) {
+                bool expected = false;
+                if (taken()[i].compare_exchange_strong(expected, true)) {
+                    index = i;
+                    return;
+                }
+            }
+        }
+        ~Holder() {
+            if (index != kNone) {
+                taken()[index].store(false);
+            }
+        }
+    };
+
+    static std::atomic<bool>* taken() {
+        static std::atomic<bool> flags[kMaxThreads] = {};
+        return flags;
+    }
+};
+
+class StripedCounter {
+public:
+    explicit StripedCounter(long long batch = 1024) : batch(batch) {}
+
+    void add(long long n) {
+        int i = ThreadIndex::get();
+        if (i == ThreadIndex::kNone) {
+            overflow.total.fetch_add(n, std::memory_order_relaxed);
+            approx.fetch_add(n, std::memory_order_relaxed);
+            return;
+        }
+        Slot& s = slots[i];
+        // We are the only writer of this slot: no atomic read-modify-write needed.
+        long long t = s.total.load(std::memory_order_relaxed) + n;
+        s.total.store(t, std::memory_order_relaxed);
+        if (t - s.pushed >= batch || s.pushed - t >= batch) {
+            approx.fetch_add(t - s.pushed, std::memory_order_relaxed);
+            s.pushed = t;
+        }
+    }
+
+    StripedCounter& operator++() {
+        add(1);
+        return *this;
+    }
+
+    // Sums every slot: O(slots).
+    long long read() const {
+        long long sum = overflow.total.load(std::memory_order_relaxed);
+        for (const Slot& s : slots) {
+            sum += s.total.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    // One load. Lags the true value by less than batch for each thread that's written.
+    long long read_approx() const { return approx.load(std::memory_order_relaxed); }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<long long> total{0};
+        long long pushed = 0; // Part of total already added to `approx`. Owner-only.
+    };
+
+    Slot slots[ThreadIndex::kMaxThreads];
+    Slot overflow;
+    alignas(64) std::atomic<long long> approx{0};
+    long long batch;
+};
+
+// --- Benchmark: Atomic.cpp's increment loop, over 1..64 threads ---
+
+std::atomic<long long> atomic_counter = {0};
+
+template<class Increment>
+double run(int threads, long long per_thread, Increment increment) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            for (long long i = 0; i < per_thread; ++i) {
+                increment();
+            }
+        });
+    }
+    for (std::thread& w : workers) {
+        w.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(threads * per_thread) / seconds / 1e6;
+}
+
+int main(int argc, char* argv[]) {
+    long long per_thread = argc > 1 ? std::stoll(argv[1]) : 2000000;
+    std::cout << "Benchmark: " << per_thread << " increments per thread, "
+              << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+    std::cout << "threads | atomic_counter++ (M ops/s) | StripedCounter (M ops/s) | exact | approx" << std::endl;
+
+    for (int threads : {1, 2, 4, 8, 16, 32, 64}) {
+        atomic_counter = 0;
+        double atomic_rate = run(threads, per_thread, [] { atomic_counter++; });
+
+        StripedCounter striped;
+        double striped_rate = run(threads, per_thread, [&striped] { ++striped; });
+
+        long long expected = threads * per_thread;
+        std::cout << threads << "\t| " << atomic_rate << "\t\t\t| " << striped_rate << "\t\t\t| "
+                  << (striped.read() == expected && atomic_counter == expected ? "ok" : "WRONG") << "\t| "
+                  << striped.read_approx() << " of " << expected << std::endl;
+    }
+
+    // Reads while writers run: read() never goes backwards, read_approx() trails it.
+    StripedCounter live;
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&] {
+            while (!stop.load(std::memory_order_relaxed)) {
+                ++live;
+            }
+        });
+    }
+    long long last = 0, reads = 0, max_lag = 0;
+    bool monotonic = true;
+    auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+    while (std::chrono::steady_clock::now() < until) {
+        long long approx = live.read_approx();
+        long long exact = live.read();
+        monotonic = monotonic && exact >= last;
+        max_lag = std::max(max_lag, exact - approx);
+        last = exact;
+        ++reads;
+    }
+    stop = true;
+    for (std::thread& w : writers) {
+        w.join();
+    }
+    std::cout << "Concurrent reads with 4 writers: " << reads << " reads, read() monotonic: "
+              << (monotonic ? "yes" : "NO") << ", largest read_approx() lag: " << max_lag
+              << " (bound " << 4 * 1024 << ")" << std::endl;
+    return 0;
+}
@@ -0,0 +1,156 @@
+// A NUMA-aware cohort lock. CohortLock.cpp explains the design and benchmarks it.
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+#include <string>
+#include <fstream>
+#include <sched.h>
+#include "Spin.h"
+
+// The NUMA node this thread is running on, as reported by getcpu().
+inline int current_node() {
+    unsigned cpu = 0, node = 0;
+    if (getcpu(&cpu, &node) != 0) {
+        return 0;
+    }
+    return static_cast<int>(node);
+}
+
+// The socket this thread runs on: its NUMA node, looked up again every kRecheck calls.
+// With simulated > 0, each thread is dealt a socket in turn the first time it asks, and keeps it.
+constexpr int kRecheck = 64;
+
+inline int this_thread_socket(int simulated) {
+    if (simulated) {
+        static std::atomic<int> next{0};
+        thread_local int dealt = next.fetch_add(1, std::memory_order_relaxed);
+        return dealt % simulated;
+    }
+    thread_local int node = 0;
+    thread_local int uses = 0;
+    if (uses++ % kRecheck == 0) {
+        node = current_node();
+    }
+    return node;
+}
+
+// Highest NUMA node number, from /sys/devices/system/node/online ("0", "0-1", "0,2-3", ...).
+inline int max_numa_node() {
+    std::ifstream in("/sys/devices/system/node/online");
+    std::string nodes;
+    if (!(in >> nodes)) {
+        return 0;
+    }
+    size_t last = nodes.find_last_of(",-");
+    return std::stoi(last == std::string::npos ? nodes : nodes.substr(last + 1));
+}
+
+class CohortLock {
+public:
+    static constexpr int kMaxSockets = 8;
+
+    // simulated_sockets == 0 uses the real topology. Otherwise threads are spread round-robin
+    // over that many pretend sockets.
+    explicit CohortLock(int simulated_sockets = 0, int max_handoffs = 64)
+        : simulated(simulated_sockets), max_handoffs(max_handoffs) {
+        if (simulated_sockets < 0 || simulated_sockets > kMaxSockets) {
+            throw std::runtime_error("CohortLock: bad simulated socket count");
+        }
+    }
+
+    CohortLock(const CohortLock&) = delete;
+    CohortLock& operator=(const CohortLock&) = delete;
+
+    void lock() {
+        Socket& s = sockets[this_thread_socket(simulated) % kMaxSockets];
+        s.waiting.fetch_add(1, std::memory_order_relaxed);
+        s.local.lock();
+        s.waiting.fetch_sub(1, std::memory_order_relaxed);
+        if (!s.has_global) {
+            lock_global(static_cast<int>(&s - sockets));
+            s.has_global = true;
+            s.handoffs = 0;
+        }
+        owner = &s; // Only the holder touches this.
+    }
+
+    bool try_lock() {
+        Socket& s = sockets[this_thread_socket(simulated) % kMaxSockets];
+        if (!s.local.try_lock()) {
+            return false;
+        }
+        if (!s.has_global) {
+            if (!try_lock_global(static_cast<int>(&s - sockets))) {
+                s.local.unlock();
+                return false;
+            }
+            s.has_global = true;
+            s.handoffs = 0;
+        }
+        owner = &s;
+        return true;
+    }
+
+    void unlock() {
+        Socket& s = *owner;
+        // s.has_global and s.handoffs are only touched under s.local.
+        if (s.waiting.load(std::memory_order_relaxed) > 0 && s.handoffs < max_handoffs &&
+            starving.load(std::memory_order_relaxed) == kNobody) {
+            ++s.handoffs; // Pass it on within the socket: keep the global lock.
+        } else {
+            s.has_global = false;
+            global.store(false, std::memory_order_release);
+        }
+        s.local.unlock();
+    }
+
+private:
+    struct alignas(64) Socket {
+        std::mutex local;
+        std::atomic<int> waiting{0}; // Threads blocked in local.lock(). A hint: being off by one only costs locality.
+        bool has_global = false;
+        int handoffs = 0;
+    };
+
+    static constexpr int kNobody = -1;
+    static constexpr int kPatience = 200; // Failed attempts before a socket declares itself starving.
+
+    // Free, and not promised to another socket.
+    bool try_lock_global(int socket) {
+        int st = starving.load(std::memory_order_relaxed);
+        if (st != kNobody && st != socket) {
+            return false;
+        }
+        if (global.load(std::memory_order_relaxed) || global.exchange(true, std::memory_order_acquire)) {
+            return false;
+        }
+        if (st == socket) {
+            starving.store(kNobody, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    void lock_global(int socket) {
+        for (int attempts = 1; !try_lock_global(socket); ++attempts) {
+            if (attempts < 100) {
+                cpu_relax();
+            } else {
+                std::this_thread::yield(); // The other socket may be holding it for a whole batch.
+            }
+            if (attempts >= kPatience) {
+                int nobody = kNobody;
+                starving.compare_exchange_strong(nobody, socket, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    Socket sockets[kMaxSockets];
+    alignas(64) std::atomic<bool> global{false};
+    std::atomic<int> starving{kNobody}; // A socket the global lock is reserved for, if any.
+    Socket* owner = nullptr;
+    const int simulated;
+    const int max_handoffs;
+};
@@ -0,0 +1,112 @@
+// Flat combining around any sequential data structure. FlatCombining.cpp explains it and benchmarks it.
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include "ThreadIndex.h"
+
+template<class DS>
+class FlatCombining {
+public:
+    template<class... Args>
+    explicit FlatCombining(Args&&... args) : ds(std::forward<Args>(args)...) {}
+
+    // Runs op(ds) as if under a lock, and returns its result.
+    template<class Op>
+    auto apply(Op op) -> decltype(op(std::declval<DS&>())) {
+        using R = decltype(op(std::declval<DS&>()));
+        Call<Op, R> call(op);
+
+        int index = ThreadIndex::get();
+        Slot& slot = slots[index];
+        slot.run = &Call<Op, R>::trampoline;
+        slot.call = &call;
+        slot.pending.store(true, std::memory_order_release);
+        int seen = highest.load(std::memory_order_relaxed);
+        while (seen < index && !highest.compare_exchange_weak(seen, index, std::memory_order_relaxed)) {
+        }
+
+        while (slot.pending.load(std::memory_order_acquire)) {
+            if (!busy.load(std::memory_order_relaxed) && !busy.exchange(true, std::memory_order_acquire)) {
+                combine();
+                busy.store(false, std::memory_order_release);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        return call.get();
+    }
+
+    // Average number of operations each combiner pass ran.
+    double average_batch() const {
+        long long p = passes.load();
+        return p ? static_cast<double>(combined.load()) / static_cast<double>(p) : 0;
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<bool> pending{false};
+        void (*run)(DS&, void*) = nullptr;
+        void* call = nullptr;
+    };
+
+    // The operation, plus room for its result, on the requesting thread's stack.
+    template<class Op, class R>
+    struct Call {
+        explicit Call(Op& op) : op(op) {}
+
+        Op& op;
+        std::conditional_t<std::is_void<R>::value, char, R> result{};
+        std::exception_ptr error;
+
+        static void trampoline(DS& ds, void* self) {
+            Call* c = static_cast<Call*>(self);
+            try {
+                if constexpr (std::is_void<R>::value) {
+                    c->op(ds);
+                } else {
+                    c->result = c->op(ds);
+                }
+            } catch (...) {
+                c->error = std::current_exception();
+            }
+        }
+
+        R get() {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            if constexpr (!std::is_void<R>::value) {
+                return std::move(result);
+            }
+        }
+    };
+
+    // Only the combiner (holder of `busy`) runs this. A couple of passes pick up requests that
+    // arrive while we're working, which makes the lock change hands less often.
+    void combine() {
+        long long ran = 0;
+        for (int pass = 0; pass < 2; ++pass) {
+            int last = highest.load(std::memory_order_relaxed);
+            for (int i = 0; i <= last; ++i) {
+                Slot& s = slots[i];
+                if (s.pending.load(std::memory_order_acquire)) {
+                    s.run(ds, s.call);
+                    s.pending.store(false, std::memory_order_release);
+                    ++ran;
+                }
+            }
+        }
+        passes.fetch_add(1, std::memory_order_relaxed);
+        combined.fetch_add(ran, std::memory_order_relaxed);
+    }
+
+    DS ds;
+    Slot slots[ThreadIndex::kMaxThreads];
+    alignas(64) std::atomic<bool> busy{false};
+    alignas(64) std::atomic<int> highest{-1}; // Highest slot index ever used.
+    std::atomic<long long> passes{0}, combined{0};
+};
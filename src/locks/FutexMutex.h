@@ -0,0 +1,107 @@
+// An adaptive futex mutex. FutexMutex.cpp explains the design and benchmarks it against glibc.
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <thread>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "Spin.h"
+
+inline std::atomic<long long> futex_calls{0}; // For the benchmark.
+
+// With a single CPU the holder can't be running while we spin, so spinning never helps.
+inline const bool kCanSpin = std::thread::hardware_concurrency() > 1;
+
+class FutexMutex {
+public:
+    FutexMutex() = default;
+    FutexMutex(const FutexMutex&) = delete;
+    FutexMutex& operator=(const FutexMutex&) = delete;
+
+    void lock() {
+        int c = 0;
+        if (word.compare_exchange_strong(c, 1, std::memory_order_acquire)) {
+            record_owner();
+            return;
+        }
+        if (c == 1 && kCanSpin && spin_then_lock()) {
+            record_owner();
+            return;
+        }
+        // Sleep. Exchanging in 2 (not 1) is what keeps unlock() honest: whoever gets the lock
+        // this way can't tell whether others still sleep, so it must assume they do.
+        c = word.exchange(2, std::memory_order_acquire);
+        while (c != 0) {
+            futex(FUTEX_WAIT_PRIVATE, 2);
+            c = word.exchange(2, std::memory_order_acquire);
+        }
+        record_owner();
+    }
+
+    bool try_lock() {
+        int c = 0;
+        if (word.compare_exchange_strong(c, 1, std::memory_order_acquire)) {
+            record_owner();
+            return true;
+        }
+        return false;
+    }
+
+    void unlock() {
+        if (word.fetch_sub(1, std::memory_order_release) != 1) {
+            // It was 2: someone may be asleep.
+            word.store(0, std::memory_order_release);
+            futex(FUTEX_WAKE_PRIVATE, 1);
+        }
+    }
+
+private:
+    static constexpr int kMinSpins = 16;
+    static constexpr int kMaxSpins = 4000;
+    static constexpr int kFractionBits = 4; // avg_spins is fixed point: spins * 16.
+
+    // The CPU the holder took the lock on. sched_getcpu() reads it from rseq: a few ns.
+    void record_owner() { owner_cpu.store(sched_getcpu(), std::memory_order_relaxed); }
+
+    bool spin_then_lock() {
+        int budget = std::min(kMaxSpins, 2 * (avg_spins.load(std::memory_order_relaxed) >> kFractionBits) + kMinSpins);
+        int me = sched_getcpu();
+        for (int i = 1; i <= budget; ++i) {
+            cpu_relax();
+            int c = word.load(std::memory_order_relaxed);
+            if (c == 2) {
+                break; // Others are already asleep; don't compete with them.
+            }
+            if (c == 1 && owner_cpu.load(std::memory_order_relaxed) == me) {
+                break; // The holder is on our CPU, so it isn't running while we spin.
+            }
+            if (c == 0 && word.compare_exchange_weak(c, 1, std::memory_order_acquire)) {
+                learn(i);
+                return true;
+            }
+        }
+        learn(0);
+        return false;
+    }
+
+    // Running average with weight 1/8, in fixed point so that samples close to the average still
+    // move it. Racy updates are fine: it's only a hint.
+    void learn(int spins) {
+        int avg = avg_spins.load(std::memory_order_relaxed);
+        avg_spins.store(avg + ((spins << kFractionBits) - avg) / 8, std::memory_order_relaxed);
+    }
+
+    void futex(int op, int val) {
+        futex_calls.fetch_add(1, std::memory_order_relaxed);
+        syscall(SYS_futex, reinterpret_cast<int*>(&word), op, val, nullptr, nullptr, 0);
+    }
+
+    std::atomic<int> word{0};
+    std::atomic<int> owner_cpu{-1};
+    std::atomic<int> avg_spins{0};
+};
+
+static_assert(sizeof(std::atomic<int>) == sizeof(int), "futex needs a plain 32-bit word");
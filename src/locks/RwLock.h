@@ -0,0 +1,88 @@
+// A reader-writer lock with per-thread reader indicators. ReadMostly.cpp explains it and benchmarks it.
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// Per-thread slot indices like ThreadIndex.h's, except that once every index is taken threads
+// share one instead of failing. The slots are reader counts, so sharing is still correct.
+class ReaderIndex {
+public:
+    static const int kMaxThreads = 128;
+
+    static int get() {
+        thread_local Holder holder;
+        return holder.index;
+    }
+
+private:
+    struct Holder {
+        int index = 0;
+        Holder() {
+            // If every index is taken, threads share: slots are counters, so that's still correct.
+            for (int i = 0; i < kMaxThreads; ++i) {
+                bool expected = false;
+                if (taken()[i].compare_exchange_strong(expected, true)) {
+                    index = i;
+                    return;
+                }
+            }
+            shared = true;
+        }
+        ~Holder() {
+            if (!shared) {
+                taken()[index].store(false);
+            }
+        }
+        bool shared = false;
+    };
+
+    static std::atomic<bool>* taken() {
+        static std::atomic<bool> flags[kMaxThreads] = {};
+        return flags;
+    }
+};
+
+class RwLock {
+public:
+    void lock_shared() {
+        std::atomic<int>& mine = slots[ReaderIndex::get()].readers;
+        while (true) {
+            mine.fetch_add(1); // seq_cst: must be visible before we look at the writer flag.
+            if (!writer.load()) {
+                return;
+            }
+            // A writer is in or waiting: step back so it can proceed, then try again.
+            mine.fetch_sub(1);
+            while (writer.load(std::memory_order_relaxed)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void unlock_shared() { slots[ReaderIndex::get()].readers.fetch_sub(1, std::memory_order_release); }
+
+    void lock() {
+        writer_mutex.lock(); // One writer at a time.
+        writer.store(true);  // seq_cst: pairs with the readers' fetch_add then load.
+        for (Slot& s : slots) {
+            while (s.readers.load() != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void unlock() {
+        writer.store(false, std::memory_order_release);
+        writer_mutex.unlock();
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<int> readers{0};
+    };
+    Slot slots[ReaderIndex::kMaxThreads];
+    alignas(64) std::atomic<bool> writer{false};
+    std::mutex writer_mutex;
+};
@@ -0,0 +1,30 @@
+// cpu_relax() and SpinWait, shared by the spinning locks.
+#pragma once
+
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+// Pauses for a while, then starts yielding the CPU as well.
+class SpinWait {
+public:
+    void wait() {
+        if (count < kSpinsBeforeYield) {
+            ++count;
+            cpu_relax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    static constexpr int kSpinsBeforeYield = 100;
+    int count = 0;
+};
@@ -0,0 +1,209 @@
+// TTAS, ticket, MCS and CLH spinlocks. SpinLocks.cpp explains how they differ and benchmarks them.
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <vector>
+#include "Spin.h"
+
+// --- TTAS with exponential backoff ---
+
+class TTASLock {
+public:
+    void lock() {
+        int backoff = 1;
+        while (true) {
+            SpinWait spin;
+            while (locked.load(std::memory_order_relaxed)) {
+                spin.wait();
+            }
+            if (!locked.exchange(true, std::memory_order_acquire)) {
+                return;
+            }
+            // Someone beat us to it: wait a growing, bounded number of pauses before looking again.
+            for (int i = 0; i < backoff; ++i) {
+                cpu_relax();
+            }
+            backoff = std::min(backoff * 2, kMaxBackoff);
+        }
+    }
+
+    bool try_lock() {
+        return !locked.load(std::memory_order_relaxed) && !locked.exchange(true, std::memory_order_acquire);
+    }
+
+    void unlock() { locked.store(false, std::memory_order_release); }
+
+private:
+    static constexpr int kMaxBackoff = 1024;
+    std::atomic<bool> locked{false};
+};
+
+// --- Ticket lock ---
+
+class TicketLock {
+public:
+    void lock() {
+        unsigned my = next_ticket.fetch_add(1, std::memory_order_relaxed);
+        SpinWait spin;
+        while (true) {
+            unsigned serving = now_serving.load(std::memory_order_acquire);
+            if (serving == my) {
+                return;
+            }
+            // Proportional backoff: the further back in line, the longer until it's our turn.
+            for (unsigned i = 0; i < (my - serving) * 16; ++i) {
+                cpu_relax();
+            }
+            spin.wait();
+        }
+    }
+
+    bool try_lock() {
+        unsigned serving = now_serving.load(std::memory_order_acquire);
+        unsigned expected = serving;
+        return next_ticket.compare_exchange_strong(expected, serving + 1, std::memory_order_acquire);
+    }
+
+    // Only the holder writes now_serving, so a load and store is enough.
+    void unlock() {
+        now_serving.store(now_serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    alignas(64) std::atomic<unsigned> next_ticket{0};
+    alignas(64) std::atomic<unsigned> now_serving{0};
+};
+
+// --- Queue nodes for MCS and CLH ---
+
+struct alignas(64) QNode {
+    std::atomic<bool> locked{false};
+    std::atomic<QNode*> next{nullptr}; // MCS only.
+};
+
+// Lockable's lock() takes no arguments, so queue nodes come from a per-thread free list instead of
+// the caller's stack. Nodes left in the list are freed when the thread exits.
+class NodePool {
+public:
+    static QNode* get() {
+        std::vector<QNode*>& free = list().nodes;
+        if (free.empty()) {
+            return new QNode();
+        }
+        QNode* n = free.back();
+        free.pop_back();
+        return n;
+    }
+
+    static void put(QNode* n) { list().nodes.push_back(n); }
+
+private:
+    struct List {
+        std::vector<QNode*> nodes;
+        ~List() {
+            for (QNode* n : nodes) {
+                delete n;
+            }
+        }
+    };
+
+    static List& list() {
+        thread_local List l;
+        return l;
+    }
+};
+
+// --- MCS lock ---
+
+class MCSLock {
+public:
+    void lock() {
+        QNode* node = NodePool::get();
+        node->next.store(nullptr, std::memory_order_relaxed);
+        node->locked.store(true, std::memory_order_relaxed);
+        QNode* prev = tail.exchange(node, std::memory_order_acq_rel);
+        if (prev) {
+            prev->next.store(node, std::memory_order_release);
+            SpinWait spin;
+            while (node->locked.load(std::memory_order_acquire)) {
+                spin.wait();
+            }
+        }
+        owner_node = node; // Only the holder touches this.
+    }
+
+    bool try_lock() {
+        QNode* node = NodePool::get();
+        node->next.store(nullptr, std::memory_order_relaxed);
+        QNode* expected = nullptr;
+        if (tail.compare_exchange_strong(expected, node, std::memory_order_acq_rel)) {
+            owner_node = node;
+            return true;
+        }
+        NodePool::put(node);
+        return false;
+    }
+
+    void unlock() {
+        QNode* node = owner_node;
+        QNode* next = node->next.load(std::memory_order_acquire);
+        if (!next) {
+            QNode* expected = node;
+            if (tail.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel)) {
+                NodePool::put(node);
+                return;
+            }
+            // A waiter swapped itself in but hasn't linked to us yet.
+            SpinWait spin;
+            while (!(next = node->next.load(std::memory_order_acquire))) {
+                spin.wait();
+            }
+        }
+        next->locked.store(false, std::memory_order_release);
+        NodePool::put(node); // Nobody references our node any more.
+    }
+
+private:
+    std::atomic<QNode*> tail{nullptr};
+    QNode* owner_node = nullptr;
+};
+
+// --- CLH lock ---
+
+class CLHLock {
+public:
+    CLHLock() : tail(new QNode()) {}
+    ~CLHLock() { delete tail.load(); }
+
+    void lock() {
+        QNode* node = NodePool::get();
+        node->locked.store(true, std::memory_order_relaxed);
+        QNode* pred = tail.exchange(node, std::memory_order_acq_rel);
+        SpinWait spin;
+        while (pred->locked.load(std::memory_order_acquire)) {
+            spin.wait();
+        }
+        owner_node = node;
+        owner_pred = pred;
+    }
+
+    // No try_lock(). Once a thread has swapped itself into `tail` it can't leave the queue, so a
+    // try_lock must only swap in when it knows the lock is free. It can't know: nodes are
+    // recycled, so `tail` can be released, reused by a new holder and swapped back in between the
+    // check and the CAS (ABA), and the CAS would succeed with the lock held. Such a try_lock either
+    // waits out a whole critical section or is wrong, so CLHLock is only BasicLockable.
+
+    void unlock() {
+        QNode* pred = owner_pred;
+        // Our successor (if any) spins on our node, so it's theirs now; we take over our
+        // predecessor's node, which nobody looks at any more.
+        owner_node->locked.store(false, std::memory_order_release);
+        NodePool::put(pred);
+    }
+
+private:
+    std::atomic<QNode*> tail;
+    QNode* owner_node = nullptr;
+    QNode* owner_pred = nullptr;
+};
@@ -0,0 +1,37 @@
+// Small per-thread indices for per-thread slot arrays.
+#pragma once
+
+#include <atomic>
+#include <stdexcept>
+
+// Hands out small per-thread indices (as in StripedCounter.cpp), reused after threads exit.
+class ThreadIndex {
+public:
+    static const int kMaxThreads = 128;
+
+    static int get() {
+        thread_local Holder holder;
+        return holder.index;
+    }
+
+private:
+    struct Holder {
+        int index = -1;
+        Holder() {
+            for (int i = 0; i < kMaxThreads; ++i) {
+                bool expected = false;
+                if (taken()[i].compare_exchange_strong(expected, true)) {
+                    index = i;
+                    return;
+                }
+            }
+            throw std::runtime_error("ThreadIndex: too many threads");
+        }
+        ~Holder() { taken()[index].store(false); }
+    };
+
+    static std::atomic<bool>* taken() {
+        static std::atomic<bool> flags[kMaxThreads] = {};
+        return flags;
+    }
+};